@@ -1,26 +1,110 @@
 // Copyright (c) 2018 Ethan Margaillan <contact@ethan.jp>.
 // Licensed under the MIT Licence - https://raw.githubusercontent.com/Ethan13310/Thread-Pool-Cpp/master/LICENSE
+//
+// Forked from https://github.com/Ethan13310/Thread-Pool-Cpp for the 5G-MAG Reference Tools MBMS modem.
+// It is maintained here and no longer tracks upstream. Differences to upstream:
+// - Worker threads run with SCHED_RR at the priority passed to the constructor, and log through spdlog
+// - Tasks are stored inline in task_type (at most task_type::capacity bytes of captures), not in std::function
+// - Pending tasks are kept in a ring that only grows when it is full, not in a std::queue
+// - post() queues a task without creating a future, so it does not allocate on the per-subframe path
 
 #pragma once
 
 #include <atomic>
 #include <condition_variable>
+#include <cstddef>
 #include <functional>
 #include <future>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 class thread_pool
 {
-	// Task function
-	using task_type = std::function<void()>;
+	// Task function, stored inline so queueing a task does not allocate
+	class task_type
+	{
+	public:
+		static constexpr std::size_t capacity = 48;
+
+		task_type() = default;
+
+		template <class Func>
+		explicit task_type(Func &&fn)
+		{
+			using func_type = typename std::decay<Func>::type;
+			static_assert(sizeof(func_type) <= capacity, "Task captures too much to be stored inline");
+			static_assert(alignof(func_type) <= alignof(std::max_align_t), "Task capture alignment not supported");
+			new (m_storage) func_type(std::forward<Func>(fn));
+			m_ops = &ops_for<func_type>;
+		}
+
+		task_type(task_type &&other) noexcept { take(other); }
+
+		task_type &operator=(task_type &&other) noexcept
+		{
+			if (this != &other) {
+				reset();
+				take(other);
+			}
+			return *this;
+		}
+
+		task_type(task_type const &) = delete;
+
+		task_type &operator=(task_type const &) = delete;
+
+		~task_type() { reset(); }
+
+		explicit operator bool() const { return m_ops != nullptr; }
+
+		void operator()() { m_ops->invoke(m_storage); }
+
+	private:
+		struct ops_type {
+			void (*invoke)(void *);
+			void (*move)(void *, void *);
+			void (*destroy)(void *);
+		};
+
+		template <class T>
+		static constexpr ops_type ops_for = {
+			[](void *p) { (*static_cast<T *>(p))(); },
+			[](void *dst, void *src) {
+				new (dst) T(std::move(*static_cast<T *>(src)));
+				static_cast<T *>(src)->~T();
+			},
+			[](void *p) { static_cast<T *>(p)->~T(); }
+		};
+
+		void take(task_type &other)
+		{
+			if (other.m_ops) {
+				other.m_ops->move(m_storage, other.m_storage);
+				m_ops = other.m_ops;
+				other.m_ops = nullptr;
+			}
+		}
+
+		void reset()
+		{
+			if (m_ops) {
+				m_ops->destroy(m_storage);
+				m_ops = nullptr;
+			}
+		}
+
+		alignas(std::max_align_t) unsigned char m_storage[capacity];
+		const ops_type *m_ops = nullptr;
+	};
 
 public:
 	explicit thread_pool(std::size_t thread_count = std::thread::hardware_concurrency(), int phy_prio = 10)
+		: m_tasks(initial_queue_size)
 	{
 		struct sched_param thread_param; 
 		thread_param.sched_priority = phy_prio; 
@@ -59,24 +143,29 @@ public:
 		) };
 
 		auto future{ task->get_future() };
-		std::unique_lock<std::mutex> lock{ m_mutex };
-
-		m_tasks.emplace([task]() {
+		enqueue(task_type{ [task]() {
 			(*task)();
-		});
-
-		lock.unlock();
-		m_notifier.notify_one();
+		} });
 		return future;
 	}
 
+	// Push a new task into the queue, without a future to wait for its result.
+	// Does not allocate as long as the queue has room, so it can be used on the per-subframe path.
+	template <class Func>
+	void post(Func &&fn)
+	{
+		enqueue(task_type{ std::forward<Func>(fn) });
+	}
+
 	// Remove all pending tasks from the queue
 	void clear()
 	{
 		std::unique_lock<std::mutex> lock{ m_mutex };
 
-		while (!m_tasks.empty()) {
-			m_tasks.pop();
+		while (m_count > 0) {
+			m_tasks[m_head] = task_type{};
+			m_head = (m_head + 1) % m_tasks.size();
+			--m_count;
 		}
 	}
 
@@ -127,25 +216,48 @@ private:
 		}
 	}
 
+	// Add a task to the ring, growing it if it is full
+	void enqueue(task_type &&task)
+	{
+		std::unique_lock<std::mutex> lock{ m_mutex };
+
+		if (m_count == m_tasks.size()) {
+			std::vector<task_type> tasks(m_tasks.size() * 2);
+			for (std::size_t i{ 0 }; i < m_count; ++i) {
+				tasks[i] = std::move(m_tasks[(m_head + i) % m_tasks.size()]);
+			}
+			m_tasks = std::move(tasks);
+			m_head = 0;
+		}
+		m_tasks[(m_head + m_count) % m_tasks.size()] = std::move(task);
+		++m_count;
+
+		lock.unlock();
+		m_notifier.notify_one();
+	}
+
 	// Get the next pending task
 	task_type next_task()
 	{
 		std::unique_lock<std::mutex> lock{ m_mutex };
 
 		m_notifier.wait(lock, [this]() {
-			return !m_tasks.empty() || m_stop;
+			return m_count > 0 || m_stop;
 		});
 
-		if (m_tasks.empty()) {
+		if (m_count == 0) {
 			// No pending task
 			return {};
 		}
 
-		auto task{ m_tasks.front() };
-		m_tasks.pop();
+		auto task{ std::move(m_tasks[m_head]) };
+		m_head = (m_head + 1) % m_tasks.size();
+		--m_count;
 		return task;
 	}
 
+	static constexpr std::size_t initial_queue_size = 1024;
+
 	std::atomic<bool> m_stop{ false };
 	std::atomic<std::size_t> m_active{ 0 };
 
@@ -153,5 +265,9 @@ private:
 	std::mutex m_mutex;
 
 	std::vector<std::thread> m_workers;
-	std::queue<task_type> m_tasks;
+
+	// Ring of pending tasks
+	std::vector<task_type> m_tasks;
+	std::size_t m_head{ 0 };
+	std::size_t m_count{ 0 };
 };
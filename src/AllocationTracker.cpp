@@ -0,0 +1,141 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "AllocationTracker.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+std::array<AllocationTracker::counters_t, static_cast<size_t>(AllocationTracker::Stage::count)> AllocationTracker::_counters;
+
+#ifdef ENABLE_ALLOCATION_TRACKING
+
+// Plain integer, so incrementing it from within operator new can never allocate
+static thread_local uint64_t thread_allocation_count = 0;
+static thread_local uint64_t thread_excluded_count = 0;
+
+static auto counted_malloc(std::size_t size) -> void* {
+  thread_allocation_count++;
+  return malloc(size == 0 ? 1 : size);  // NOLINT
+}
+
+static auto counted_aligned_malloc(std::size_t size, std::align_val_t align) -> void* {
+  thread_allocation_count++;
+  void* ptr = nullptr;
+  auto alignment = std::max(static_cast<std::size_t>(align), sizeof(void*));
+  if (posix_memalign(&ptr, alignment, size == 0 ? 1 : size) != 0) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+auto operator new(std::size_t size) -> void* {
+  if (auto ptr = counted_malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+auto operator new[](std::size_t size) -> void* {
+  if (auto ptr = counted_malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+auto operator new(std::size_t size, const std::nothrow_t& /*tag*/) noexcept -> void* {
+  return counted_malloc(size);
+}
+
+auto operator new[](std::size_t size, const std::nothrow_t& /*tag*/) noexcept -> void* {
+  return counted_malloc(size);
+}
+
+auto operator new(std::size_t size, std::align_val_t align) -> void* {
+  if (auto ptr = counted_aligned_malloc(size, align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+auto operator new[](std::size_t size, std::align_val_t align) -> void* {
+  if (auto ptr = counted_aligned_malloc(size, align)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }  // NOLINT
+void operator delete[](void* ptr) noexcept { free(ptr); }  // NOLINT
+void operator delete(void* ptr, std::size_t /*size*/) noexcept { free(ptr); }  // NOLINT
+void operator delete[](void* ptr, std::size_t /*size*/) noexcept { free(ptr); }  // NOLINT
+void operator delete(void* ptr, std::align_val_t /*align*/) noexcept { free(ptr); }  // NOLINT
+void operator delete[](void* ptr, std::align_val_t /*align*/) noexcept { free(ptr); }  // NOLINT
+void operator delete(void* ptr, std::size_t /*size*/, std::align_val_t /*align*/) noexcept { free(ptr); }  // NOLINT
+void operator delete[](void* ptr, std::size_t /*size*/, std::align_val_t /*align*/) noexcept { free(ptr); }  // NOLINT
+
+auto AllocationTracker::thread_allocations() -> uint64_t {
+  return thread_allocation_count - thread_excluded_count;
+}
+
+auto AllocationTracker::raw_thread_allocations() -> uint64_t {
+  return thread_allocation_count;
+}
+
+void AllocationTracker::exclude(uint64_t allocations) {
+  thread_excluded_count += allocations;
+}
+
+#else
+
+auto AllocationTracker::thread_allocations() -> uint64_t {
+  return 0;
+}
+
+auto AllocationTracker::raw_thread_allocations() -> uint64_t {
+  return 0;
+}
+
+void AllocationTracker::exclude(uint64_t /*allocations*/) {}
+
+#endif
+
+void AllocationTracker::add(Stage stage, uint64_t allocations) {
+  auto& c = _counters[static_cast<size_t>(stage)];
+  c.ttis.fetch_add(1, std::memory_order_relaxed);
+  c.allocations.fetch_add(allocations, std::memory_order_relaxed);
+  auto max = c.max_per_tti.load(std::memory_order_relaxed);
+  while (allocations > max && !c.max_per_tti.compare_exchange_weak(max, allocations, std::memory_order_relaxed)) {}
+}
+
+auto AllocationTracker::summary(Stage stage, bool reset) -> summary_t {
+  auto& c = _counters[static_cast<size_t>(stage)];
+  summary_t s = {};
+  if (reset) {
+    s.ttis = c.ttis.exchange(0, std::memory_order_relaxed);
+    s.allocations = c.allocations.exchange(0, std::memory_order_relaxed);
+    s.max_per_tti = c.max_per_tti.exchange(0, std::memory_order_relaxed);
+  } else {
+    s.ttis = c.ttis.load(std::memory_order_relaxed);
+    s.allocations = c.allocations.load(std::memory_order_relaxed);
+    s.max_per_tti = c.max_per_tti.load(std::memory_order_relaxed);
+  }
+  return s;
+}
@@ -0,0 +1,138 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ *  Heap allocation counters for finding allocations on the per-subframe path.
+ *
+ *  In builds configured with -DENABLE_ALLOCATION_TRACKING=ON, the global operator new is
+ *  replaced by one that counts allocations per thread. The main loop and the frame processors
+ *  record how many allocations happened while handling each TTI, and the summary is logged
+ *  with the measurement interval. In steady-state processing, all counts should be zero, which
+ *  the --allocation-test command line option checks on a replayed sample file.
+ *
+ *  In regular builds, all methods compile to no-ops.
+ *
+ *  Only C++ allocations are counted. malloc calls inside srsran are not.
+ */
+class AllocationTracker {
+  public:
+    /**
+     *  Code paths allocations are recorded for
+     */
+    enum class Stage {
+      main_loop,       /**< Main loop, once per TTI */
+      cas_subframe,    /**< CasFrameProcessor::process() */
+      mbsfn_subframe,  /**< MbsfnFrameProcessor::process(), per subframe of the batch */
+      count
+    };
+
+    typedef struct {
+      uint64_t ttis;
+      uint64_t allocations;
+      uint64_t max_per_tti;
+    } summary_t;
+
+    /**
+     *  True if the build counts allocations
+     */
+    static constexpr bool enabled() {
+#ifdef ENABLE_ALLOCATION_TRACKING
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    /**
+     *  Number of allocations made by the calling thread since it was started, outside of Pause scopes
+     */
+    static uint64_t thread_allocations();
+
+    /**
+     *  Record the number of allocations done while handling one TTI in a stage
+     */
+    static void add(Stage stage, uint64_t allocations);
+
+    /**
+     *  Get the counters for a stage.
+     *
+     *  @param reset Clear the counters after reading
+     */
+    static summary_t summary(Stage stage, bool reset);
+
+    /**
+     *  Records the allocations of the calling thread between construction and destruction
+     *  for one TTI.
+     */
+    class Scope {
+      public:
+        explicit Scope(Stage stage)
+          : _stage(stage)
+          , _start(enabled() ? thread_allocations() : 0) {}
+        ~Scope() {
+          if (enabled()) {
+            add(_stage, thread_allocations() - _start);
+          }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+      private:
+        Stage _stage;
+        uint64_t _start;
+    };
+
+    /**
+     *  Excludes the allocations of the calling thread between construction and destruction from
+     *  thread_allocations(), for calls out of the PHY that are known to allocate (e.g. RRC parsing SIBs).
+     */
+    class Pause {
+      public:
+        Pause()
+          : _start(enabled() ? raw_thread_allocations() : 0) {}
+        ~Pause() {
+          if (enabled()) {
+            exclude(raw_thread_allocations() - _start);
+          }
+        }
+        Pause(const Pause&) = delete;
+        Pause& operator=(const Pause&) = delete;
+
+      private:
+        uint64_t _start;
+    };
+
+  private:
+    static uint64_t raw_thread_allocations();
+    static void exclude(uint64_t allocations);
+
+    struct counters_t {
+      std::atomic<uint64_t> ttis = {0};
+      std::atomic<uint64_t> allocations = {0};
+      std::atomic<uint64_t> max_per_tti = {0};
+    };
+    static std::array<counters_t, static_cast<size_t>(Stage::count)> _counters;
+};
@@ -0,0 +1,90 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "AntennaSelector.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+// Weight of a new SNR value in the smoothed SNR
+static const float kSnrFilterWeight = 0.05;
+
+AntennaSelector::AntennaSelector(const libconfig::Config& cfg, unsigned rx_channels)
+  : _rx_channels(std::min(rx_channels, static_cast<unsigned>(SRSRAN_MAX_PORTS)))
+{
+  cfg.lookupValue("modem.phy.antenna_selection.enabled", _enabled);
+  cfg.lookupValue("modem.phy.antenna_selection.enter_snr_db", _enter_snr_db);
+  cfg.lookupValue("modem.phy.antenna_selection.exit_snr_db", _exit_snr_db);
+  cfg.lookupValue("modem.phy.antenna_selection.holdoff_subframes", _holdoff);
+  _enabled = _enabled && _rx_channels > 1;
+  if (_enabled) {
+    spdlog::info("Antenna selection enabled: single antenna above {} dB, combining below {} dB", _enter_snr_db, _exit_snr_db);
+  }
+}
+
+void AntennaSelector::report_snr(const float* snr_db) {
+  if (!_enabled) {
+    return;
+  }
+  const std::lock_guard<std::mutex> lock(_mutex);
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    _snr_db[ch] = _snr_valid ? _snr_db[ch] + kSnrFilterWeight * (snr_db[ch] - _snr_db[ch]) : snr_db[ch];
+  }
+  _snr_valid = true;
+  update();
+}
+
+void AntennaSelector::report_crc(uint32_t tti, bool crc_ok) {
+  if (!_enabled) {
+    return;
+  }
+  const std::lock_guard<std::mutex> lock(_mutex);
+  if (crc_ok) {
+    _clean_subframes = std::min(_clean_subframes + 1, _holdoff);
+    return;
+  }
+  _clean_subframes = 0;
+  if (_selected != kAllAntennas) {
+    spdlog::info("MBSFN CRC error in TTI {}, combining all antennas again", tti);
+    _selected = kAllAntennas;
+  }
+}
+
+void AntennaSelector::update() {
+  auto best = static_cast<int>(std::max_element(_snr_db.begin(), _snr_db.begin() + _rx_channels) - _snr_db.begin());
+  auto best_snr = _snr_db[best];
+
+  int selected = _selected;
+  if (selected == kAllAntennas) {
+    if (best_snr >= _enter_snr_db && _clean_subframes >= _holdoff) {
+      spdlog::info("Antenna {} SNR {:.1f} dB, decoding MBSFN from this antenna only", best, best_snr);
+      _selected = best;
+    }
+  } else if (_snr_db[selected] < _exit_snr_db) {
+    if (best != selected && best_snr >= _enter_snr_db) {
+      spdlog::info("Antenna {} SNR down to {:.1f} dB, switching MBSFN decoding to antenna {} ({:.1f} dB)",
+          selected, _snr_db[selected], best, best_snr);
+      _selected = best;
+    } else {
+      spdlog::info("Antenna {} SNR down to {:.1f} dB, combining all antennas again", selected, _snr_db[selected]);
+      _selected = kAllAntennas;
+    }
+  }
+}
@@ -0,0 +1,95 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <libconfig.h++>
+#include "srsran/srsran.h"
+
+/**
+ *  Decides whether MBSFN subframes are decoded from all receive channels, or only the best one.
+ *
+ *  With good reception on every antenna, MMSE combining of several antennas doubles the cost of FFT,
+ *  channel estimation and equalization without improving the decoding result. The CAS processor reports
+ *  the SNR per antenna of every CAS subframe. If the best antenna's (smoothed) SNR is above
+ *  enter_snr_db and no MBSFN subframe has failed recently, the MBSFN processors are told to use only
+ *  that antenna. Once the selected antenna's SNR drops below exit_snr_db, decoding switches to another
+ *  antenna above enter_snr_db if there is one. Otherwise, and whenever an MBSFN subframe fails its CRC,
+ *  all antennas are combined again. After a CRC failure, single antenna mode is only entered again once
+ *  holdoff_subframes MBSFN subframes in a row have been decoded.
+ */
+class AntennaSelector {
+  public:
+    /**
+     *  Value of selected() if all antennas are to be combined
+     */
+    static const int kAllAntennas = -1;
+
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param rx_channels Nr of receive channels
+     */
+    AntennaSelector(const libconfig::Config& cfg, unsigned rx_channels);
+
+    /**
+     *  Returns true if antenna selection is enabled and there is more than one antenna to choose from
+     */
+    bool enabled() const { return _enabled; }
+
+    /**
+     *  The antenna MBSFN subframes should be decoded from, or kAllAntennas
+     */
+    int selected() const { return _selected.load(std::memory_order_relaxed); }
+
+    /**
+     *  Report the SNR per receive channel, as estimated from a CAS subframe.
+     *
+     *  @param snr_db SNR in dB, one value per receive channel
+     */
+    void report_snr(const float* snr_db);
+
+    /**
+     *  Report the result of decoding an MBSFN subframe
+     *
+     *  @param tti TTI of the subframe
+     *  @param crc_ok True if the TB passed its CRC
+     */
+    void report_crc(uint32_t tti, bool crc_ok);
+
+  private:
+    void update();
+
+    bool _enabled = false;
+    unsigned _rx_channels;
+    float _enter_snr_db = 20.0;
+    float _exit_snr_db = 15.0;
+    unsigned _holdoff = 1000;
+
+    std::mutex _mutex;
+    std::array<float, SRSRAN_MAX_PORTS> _snr_db = {};
+    bool _snr_valid = false;
+    unsigned _clean_subframes = 0;
+    std::atomic<int> _selected = {kAllAntennas};
+};
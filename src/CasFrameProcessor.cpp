@@ -18,27 +18,20 @@
 //
 
 #include "CasFrameProcessor.h"
-#include "spdlog/spdlog.h"
-
 
-auto CasFrameProcessor::init() -> bool {
-  _signal_buffer_max_samples = 3 * SRSRAN_SF_LEN_PRB(MAX_PRB);
+#include <algorithm>
 
-  for (auto ch = 0U; ch < _rx_channels; ch++) {
-    _signal_buffer_rx[ch] = srsran_vec_cf_malloc(_signal_buffer_max_samples);
-    if (!_signal_buffer_rx[ch]) {
-      spdlog::error("Could not allocate regular DL signal buffer\n");
-      return false;
-    }
-  }
+#include "AllocationTracker.h"
+#include "spdlog/spdlog.h"
 
-  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, MAX_PRB, _rx_channels)) {
-    spdlog::error("Could not init ue_dl\n");
-    return false;;
-  }
+// Decimation filter length per CAS sample period. The filter length per phase is derived from it
+// and the rate ratio, so the transition band stays the same for every ratio.
+static const unsigned kDecimationTapsPerSample = 24;
 
-  srsran_softbuffer_rx_init(&_softbuffer, 100);
+static const uint32_t kTtiWrap = 10240;
 
+auto CasFrameProcessor::init() -> bool {
+  // Signal buffers, ue_dl and softbuffer are allocated in set_cell(), once the bandwidth is known.
   _ue_dl_cfg.snr_to_cqi_offset = 0;
 
   for (auto & i : _data) {
@@ -76,17 +69,120 @@ CasFrameProcessor::~CasFrameProcessor() {
       free(i);
     }
   }
-  srsran_softbuffer_rx_free(&_softbuffer);
-  srsran_ue_dl_free(&_ue_dl);
+  free_buffers();
+}
+
+void CasFrameProcessor::free_buffers() {
+  // Also cleans up after a resize() that failed half way, so everything is released on its own
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    if (_signal_buffer_rx[ch]) {
+      _arena.release(_signal_buffer_rx[ch]);
+      _signal_buffer_rx[ch] = nullptr;
+    }
+    if (_wide_buffer_rx[ch]) {
+      _arena.release(_wide_buffer_rx[ch]);
+      _wide_buffer_rx[ch] = nullptr;
+    }
+  }
+  _resampler.reset();
+  _wide_prb = 0;
+  _wide_buffer_samples = 0;
+  if (_has_softbuffer) {
+    srsran_softbuffer_rx_free(&_softbuffer);
+    _has_softbuffer = false;
+  }
+  if (_has_ue_dl) {
+    srsran_ue_dl_free(&_ue_dl);
+    _ue_dl = {};
+    _has_ue_dl = false;
+  }
+  _allocated_prb = 0;
+  _signal_buffer_max_samples = 0;
 }
 
-void CasFrameProcessor::set_cell(srsran_cell_t cell) {
+auto CasFrameProcessor::resize(uint32_t nof_prb, uint32_t wide_prb) -> bool {
+  if (nof_prb == _allocated_prb && wide_prb == _wide_prb) {
+    return true;
+  }
+
+  free_buffers();
+
+  // The decimated subframe can be a sample longer than SF_LEN, leave some room
+  _signal_buffer_max_samples = SRSRAN_SF_LEN_PRB(nof_prb);
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    _signal_buffer_rx[ch] = _arena.allocate_cf(_signal_buffer_max_samples + (wide_prb ? 2 : 0));
+    if (!_signal_buffer_rx[ch]) {
+      spdlog::error("Could not allocate regular DL signal buffer\n");
+      return false;
+    }
+  }
+
+  if (wide_prb) {
+    // Subframes are received at the sample rate of the wider MBSFN carrier, and decimated to the CAS rate
+    _wide_buffer_samples = SRSRAN_SF_LEN_PRB(wide_prb);
+    _wide_heads.resize(_rx_channels);
+    _narrow_heads.resize(_rx_channels);
+    for (auto ch = 0U; ch < _rx_channels; ch++) {
+      _wide_buffer_rx[ch] = _arena.allocate_cf(_wide_buffer_samples);
+      if (!_wide_buffer_rx[ch]) {
+        spdlog::error("Could not allocate wideband DL signal buffer\n");
+        return false;
+      }
+      _wide_heads[ch] = _wide_buffer_rx[ch];
+      _narrow_heads[ch] = _signal_buffer_rx[ch];
+    }
+    auto wide_rate = static_cast<uint32_t>(srsran_sampling_freq_hz(wide_prb));
+    auto cas_rate = static_cast<uint32_t>(srsran_sampling_freq_hz(nof_prb));
+    auto taps = Resampler::taps_per_phase_for(wide_rate, cas_rate, kDecimationTapsPerSample);
+    _resampler = std::make_unique<Resampler>(wide_rate, cas_rate, _rx_channels, _wide_buffer_samples, taps);
+    if (!_resampler->valid()) {
+      spdlog::error("Cannot decimate CAS subframes from {} to {} PRB\n", wide_prb, nof_prb);
+      return false;
+    }
+    _resampler_next_tti = kTtiWrap;
+    _wide_prb = wide_prb;
+    spdlog::info("Decimating CAS subframes from {} to {} PRB before processing ({}:{}, {} taps per phase)",
+        wide_prb, nof_prb, _resampler->interpolation(), _resampler->decimation(), taps);
+  }
+
+  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, nof_prb, _rx_channels)) {
+    spdlog::error("Could not init ue_dl\n");
+    return false;
+  }
+  _has_ue_dl = true;
+
+  if (srsran_softbuffer_rx_init(&_softbuffer, nof_prb) != SRSRAN_SUCCESS) {
+    spdlog::error("Could not init softbuffer\n");
+    return false;
+  }
+  _has_softbuffer = true;
+  _allocated_prb = nof_prb;
+
+  spdlog::info("CAS processor sized for {} PRB: {:.1f} kB sample buffers, {:.1f} kB softbuffer",
+      nof_prb,
+      static_cast<double>(_rx_channels * _signal_buffer_max_samples * sizeof(cf_t)) / 1024.0,
+      static_cast<double>(_softbuffer.max_cb * (_softbuffer.max_cb_size * sizeof(int16_t) + _softbuffer.max_cb_size / 8 + sizeof(bool))) / 1024.0);
+  return true;
+}
+
+auto CasFrameProcessor::set_cell(srsran_cell_t cell) -> bool {
   _cell = cell;
   spdlog::debug("CAS processor setting cell ({} PRB / {} MBSFN PRB).", cell.nof_prb, cell.mbsfn_prb);
+  if (_narrowband && cell.mbsfn_prb > cell.nof_prb) {
+    if (!resize(cell.nof_prb, cell.mbsfn_prb)) {
+      return false;
+    }
+    // ue_dl only ever sees the decimated subframe
+    cell.mbsfn_prb = cell.nof_prb;
+  } else if (!resize(std::max(cell.nof_prb, cell.mbsfn_prb), 0)) {
+    return false;
+  }
   srsran_ue_dl_set_cell(&_ue_dl, cell);
+  return true;
 }
 
 auto CasFrameProcessor::process(uint32_t tti) -> bool {
+  AllocationTracker::Scope allocations(AllocationTracker::Stage::cas_subframe);
   _sf_cfg.tti = tti;
   _sf_cfg.cfi = _cell.semi_static_cfi ? _cell.semi_static_cfi : 0;
   _sf_cfg.sf_type = SRSRAN_SF_NORM;
@@ -98,17 +194,36 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
 
   _rest._pdsch.total++;
 
+  if (_resampler) {
+    // CAS and MBSFN share the center frequency, so a lowpass and decimation is all it takes to get
+    // to the CAS bandwidth. The filter delay puts the FFT window a few samples into the CP, which
+    // channel estimation absorbs. The filter state carries over from the previous subframe if it
+    // directly preceded this one, otherwise the filter starts over.
+    if (tti != _resampler_next_tti) {
+      _resampler->reset();
+    }
+    _resampler_next_tti = (tti + 1) % kTtiWrap;
+    _resampler->process(_wide_heads, _wide_buffer_samples, _narrow_heads);
+  }
+
   // Run the FFT and do channel estimation
   if (srsran_ue_dl_decode_fft_estimate(&_ue_dl, &_sf_cfg, &_ue_dl_cfg) < 0) {
     _rest._pdsch.errors++;
     spdlog::error("Getting PDCCH FFT estimate\n");
-    _mutex.unlock();
     return false;
   }
 
   // Feedback the CFO from CE to the Phy
   _phy.set_cfo_from_channel_estimation(_ue_dl.chest_res.cfo);
 
+  if (_antenna_selector.enabled()) {
+    float snr_db[SRSRAN_MAX_PORTS] = {};  // NOLINT
+    for (auto ch = 0U; ch < _rx_channels; ch++) {
+      snr_db[ch] = _ue_dl.chest_res.snr_ant_port_db[ch][0];
+    }
+    _antenna_selector.report_snr(snr_db);
+  }
+
   // Try to decode DCIs from PDCCH
   srsran_dci_dl_t dci[SRSRAN_MAX_CARRIERS] = {};    // NOLINT
   int nof_grants = srsran_ue_dl_find_dl_dci(&_ue_dl, &_sf_cfg, &_ue_dl_cfg, _cell.mbms_dedicated ? SRSRAN_SIRNTI_MBMS_DEDICATED : SRSRAN_SIRNTI, dci);
@@ -120,7 +235,6 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
 
     if (srsran_ue_dl_dci_to_pdsch_grant(&_ue_dl, &_sf_cfg, &_ue_dl_cfg, &dci[k], &_ue_dl_cfg.cfg.pdsch.grant)) {
       spdlog::error("Converting DCI message to DL dci\n");
-    _mutex.unlock();
       return false;
     }
 
@@ -142,8 +256,7 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
       }
     }
 
-    _rest._pdsch.SetData(pdsch_data());
-    _rest._ce_values = ce_values();
+    take_snapshots();
 
     // Decode PDSCH..
     auto ret = srsran_ue_dl_decode_pdsch(&_ue_dl, &_sf_cfg, &_ue_dl_cfg.cfg.pdsch, pdsch_res);
@@ -155,26 +268,31 @@ auto CasFrameProcessor::process(uint32_t tti) -> bool {
       for (int i = 0; i < SRSRAN_MAX_CODEWORDS; i++) {
         // .. and pass received PDUs to RLC for further processing
         if (pdsch_cfg->grant.tb[i].enabled && pdsch_res[i].crc) {
+          // RRC unpacks the SIBs with the srsran ASN.1 decoder, which allocates. That is control plane
+          // work on a few subframes per radio frame, and not counted for the PHY.
+          AllocationTracker::Pause rrc_allocations;
           _rlc.write_pdu_bcch_dlsch(_data[i], (uint32_t)pdsch_cfg->grant.tb[i].tbs);
         }
       }
     }
   }
-    _mutex.unlock();
   return true;
 }
 
-auto CasFrameProcessor::ce_values() -> std::vector<uint8_t> {
+void CasFrameProcessor::take_snapshots() {
+  // Constellation diagram data (I/Q data of the subcarriers after CE)
+  if (_rest._pdsch.WantsData()) {
+    const uint8_t* pdsch = reinterpret_cast<uint8_t*>(_ue_dl.pdsch.d[0]);
+    _rest._pdsch.SetData(pdsch, _ue_dl_cfg.cfg.pdsch.grant.nof_re * sizeof(cf_t));
+  }
+
+  // CE values (time domain) for displaying the spectrum of the received signal
+  if (!_rest._ce_values.WantsData()) {
+    return;
+  }
   auto sz = (uint32_t)srsran_symbol_sz(_cell.nof_prb);
-  std::vector<float> ce_abs;
-  ce_abs.resize(sz, 0);
+  _ce_abs.assign(sz, 0);
   uint32_t g = (sz - 12 * _cell.nof_prb) / 2;
-  srsran_vec_abs_dB_cf(_ue_dl.chest_res.ce[0][0], -80, &ce_abs[g], SRSRAN_NRE * _cell.nof_prb);
-  const uint8_t* data = reinterpret_cast<uint8_t*>(ce_abs.data());
-  return { data, data + sz * sizeof(float)};
-}
-
-auto CasFrameProcessor::pdsch_data() -> std::vector<uint8_t> {
-  const uint8_t* data = reinterpret_cast<uint8_t*>(_ue_dl.pdsch.d[0]);
-  return { data, data + _ue_dl_cfg.cfg.pdsch.grant.nof_re * sizeof(cf_t)};
+  srsran_vec_abs_dB_cf(_ue_dl.chest_res.ce[0][0], -80, &_ce_abs[g], SRSRAN_NRE * _cell.nof_prb);
+  _rest._ce_values.SetData(reinterpret_cast<uint8_t*>(_ce_abs.data()), sz * sizeof(float));
 }
@@ -20,13 +20,17 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <thread>
 #include "srsran/srsran.h"
 #include "srsran/rlc/rlc.h"
+#include "AntennaSelector.h"
 #include "Phy.h"
+#include "Resampler.h"
 #include "RestHandler.h"
+#include "HugePageArena.h"
 #include <libconfig.h++>
 
 /**
@@ -43,13 +47,19 @@ class CasFrameProcessor {
     *  @param phy PHY reference
     *  @param rlc RLC reference
     *  @param rest RESTful API handler reference
+    *  @param arena Memory arena for the sample buffers
+    *  @param antenna_selector Gets the SNR per antenna
     */
-   CasFrameProcessor(const libconfig::Config& /*cfg*/, Phy& phy, srsran::rlc& rlc, RestHandler& rest, unsigned rx_channels)
+   CasFrameProcessor(const libconfig::Config& cfg, Phy& phy, srsran::rlc& rlc, RestHandler& rest, HugePageArena& arena, AntennaSelector& antenna_selector, unsigned rx_channels)
      : _rlc(rlc)
      , _phy(phy)
      , _rest(rest)
+     , _arena(arena)
+     , _antenna_selector(antenna_selector)
      , _rx_channels(rx_channels)
-     {}
+     {
+       cfg.lookupValue("modem.phy.narrowband_cas", _narrowband);
+     }
 
    /**
     *  Default destructor.
@@ -57,8 +67,8 @@ class CasFrameProcessor {
    virtual ~CasFrameProcessor();
 
    /**
-    *  Initialize signal- and softbuffers, init all underlying components. 
-    *  Must be called once before the first call to process().
+    *  Initialize the static processing parameters.
+    *  Must be called once before the first call to set_cell().
     */
    bool init();
 
@@ -72,38 +82,27 @@ class CasFrameProcessor {
 
    /**
     *  Set the parameters for the cell (Nof PRB, etc).
+    *
+    *  Signal buffers, ue_dl and softbuffer are (re)allocated if the bandwidth has changed.
+    *  If the MBSFN carrier is wider than the CAS, subframes are received at the MBSFN sample rate.
+    *  With narrowband CAS processing (the default), they are then decimated to the CAS sample rate,
+    *  and ue_dl is sized for the CAS bandwidth only. Otherwise ue_dl works at the wide rate.
     * 
     *  @param cell The cell we're camping on
     */
-   void set_cell(srsran_cell_t cell);
+   bool set_cell(srsran_cell_t cell);
 
    /**
-    *  Get a handle of the signal buffer to store samples for processing in
+    *  Get a handle of the signal buffer to store samples for processing in.
+    *
+    *  Must only be called by the current owner of the processor, after acquiring it from its ProcessorPool.
     */
-   cf_t** rx_buffer() {  _mutex.lock(); return _signal_buffer_rx; }
+   cf_t** rx_buffer() { return _resampler ? _wide_buffer_rx : _signal_buffer_rx; }
 
    /**
     *  Size of the signal buffer
     */
-   uint32_t rx_buffer_size() { return _signal_buffer_max_samples; }
-
-    /**
-     *  Unlock the processor
-     *
-     *  @see get_rx_buffer_and_lock() 
-     */
-    void unlock() { _mutex.unlock(); }
-
-   /**
-    *  Get the CE values (time domain) for displaying the spectrum
-    *  of the received signal
-    */
-   std::vector<uint8_t> ce_values();
-
-   /**
-    *  Get the constellation diagram data (I/Q data of the subcarriers after CE)
-    */
-   std::vector<uint8_t> pdsch_data();
+   uint32_t rx_buffer_size() { return _resampler ? _wide_buffer_samples : _signal_buffer_max_samples; }
 
    /**
     *  Get the CINR estimate (in dB)
@@ -111,21 +110,40 @@ class CasFrameProcessor {
    float cinr_db() { return _ue_dl.chest_res.snr_db; }
 
  private:
+    void take_snapshots();
+    bool resize(uint32_t nof_prb, uint32_t wide_prb);
+    void free_buffers();
+
     srsran::rlc& _rlc;
     Phy& _phy;
     RestHandler& _rest;
+    HugePageArena& _arena;
+    AntennaSelector& _antenna_selector;
 
     cf_t*    _signal_buffer_rx[SRSRAN_MAX_PORTS] = {};
     uint32_t _signal_buffer_max_samples          = 0;
 
-    srsran_softbuffer_rx_t _softbuffer;
-    uint8_t* _data[SRSRAN_MAX_CODEWORDS];
+    uint32_t _allocated_prb = 0;
+
+    bool _narrowband = true;
+    uint32_t _wide_prb = 0;                            /**< Receive bandwidth if decimating to the CAS bandwidth, 0 otherwise */
+    cf_t*    _wide_buffer_rx[SRSRAN_MAX_PORTS] = {};
+    uint32_t _wide_buffer_samples              = 0;
+    std::unique_ptr<Resampler> _resampler;
+    uint32_t _resampler_next_tti = 0;                  /**< TTI that continues the samples in the resampler's filter state */
+    std::vector<void*> _wide_heads;
+    std::vector<void*> _narrow_heads;
+
+    srsran_softbuffer_rx_t _softbuffer = {};
+    bool _has_softbuffer = false;
+    uint8_t* _data[SRSRAN_MAX_CODEWORDS] = {};
+    std::vector<float> _ce_abs;
 
     srsran_ue_dl_t     _ue_dl     = {};
+    bool _has_ue_dl = false;
     srsran_ue_dl_cfg_t _ue_dl_cfg = {};
     srsran_dl_sf_cfg_t _sf_cfg = {};
 
     srsran_cell_t _cell;
-    std::mutex _mutex;
     unsigned _rx_channels;
 };
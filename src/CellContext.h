@@ -0,0 +1,135 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "srsran/srsran.h"
+
+/**
+ *  Immutable description of the cell and MBSFN configuration the frame processors are set up for.
+ *
+ *  The main loop creates a new context whenever the cell, MBSFN area or subcarrier spacing changes,
+ *  and hands the same shared, read-only instance to every processor. A processor only
+ *  reconfigures when it gets a context other than the one it was last configured with, which
+ *  is a pointer comparison in the per-subframe path.
+ *
+ *  Only the parameters are shared. The tables derived from them (FFT plans, scrambling sequences,
+ *  reference signals) are still built by every processor's own srsran ue_dl objects.
+ */
+class CellContext {
+  public:
+    /**
+     *  Create a context.
+     *
+     *  @param cell The cell we're camping on (CAS parameters, incl. MBSFN PRB)
+     *  @param area_id MBSFN area ID
+     *  @param subcarrier_spacing MBSFN subcarrier spacing
+     */
+    static std::shared_ptr<const CellContext> create(const srsran_cell_t& cell, uint8_t area_id, srsran_scs_t subcarrier_spacing) {
+      return std::shared_ptr<const CellContext>(new CellContext(cell, area_id, subcarrier_spacing));
+    }
+
+    /**
+     *  Returns true if this context describes the given parameters
+     */
+    bool matches(const srsran_cell_t& cell, uint8_t area_id, srsran_scs_t subcarrier_spacing) const {
+      return _cell.id == cell.id &&
+        _cell.nof_prb == cell.nof_prb &&
+        _cell.mbsfn_prb == cell.mbsfn_prb &&
+        _cell.cp == cell.cp &&
+        _cell.mbms_dedicated == cell.mbms_dedicated &&
+        _area_id == area_id &&
+        _scs == subcarrier_spacing;
+    }
+
+    /**
+     *  The cell as seen by the MBSFN processors: nof_prb is set to the MBSFN bandwidth
+     */
+    const srsran_cell_t& mbsfn_cell() const { return _mbsfn_cell; }
+
+    uint8_t area_id() const { return _area_id; }
+    srsran_scs_t subcarrier_spacing() const { return _scs; }
+
+    /**
+     *  Nr of samples in one MBSFN subframe
+     */
+    uint32_t sf_len() const { return SRSRAN_SF_LEN_PRB(_mbsfn_cell.nof_prb); }
+
+    /**
+     *  Nr of samples an MBSFN receive buffer must hold. With 0.37 kHz subcarrier spacing,
+     *  one MBSFN symbol spans 3 subframes.
+     */
+    uint32_t rx_buffer_samples() const { return (_scs == SRSRAN_SCS_0KHZ37 ? 3 : 1) * sf_len(); }
+
+    /**
+     *  Nr of resource elements in the MBSFN resource grid of one subframe
+     */
+    uint32_t re_per_subframe() const {
+      return SRSRAN_NRE * fft_size_factor(_scs) * symbols_per_subframe(_scs) * _mbsfn_cell.nof_prb;
+    }
+
+    /**
+     *  All MBSFN subcarrier spacings
+     */
+    static constexpr srsran_scs_t kSubcarrierSpacings[] = {
+      SRSRAN_SCS_15KHZ, SRSRAN_SCS_7KHZ5, SRSRAN_SCS_2KHZ5, SRSRAN_SCS_1KHZ25, SRSRAN_SCS_0KHZ37};
+
+    /**
+     *  FFT size for a subcarrier spacing, relative to the 15 kHz symbol size
+     */
+    static constexpr uint32_t fft_size_factor(srsran_scs_t subcarrier_spacing) {
+      switch (subcarrier_spacing) {
+        case SRSRAN_SCS_7KHZ5:  return 2;
+        case SRSRAN_SCS_2KHZ5:  return 6;
+        case SRSRAN_SCS_1KHZ25: return 12;
+        case SRSRAN_SCS_0KHZ37: return 40;
+        default:                return 1;
+      }
+    }
+
+    /**
+     *  Nr of OFDM symbols in one MBSFN subframe (extended CP). A 0.37 kHz symbol spans 3 subframes.
+     */
+    static constexpr uint32_t symbols_per_subframe(srsran_scs_t subcarrier_spacing) {
+      switch (subcarrier_spacing) {
+        case SRSRAN_SCS_7KHZ5:  return 6;
+        case SRSRAN_SCS_2KHZ5:  return 2;
+        case SRSRAN_SCS_1KHZ25: return 1;
+        case SRSRAN_SCS_0KHZ37: return 1;
+        default:                return 12;
+      }
+    }
+
+  private:
+    CellContext(const srsran_cell_t& cell, uint8_t area_id, srsran_scs_t subcarrier_spacing)
+      : _cell(cell)
+      , _mbsfn_cell(cell)
+      , _area_id(area_id)
+      , _scs(subcarrier_spacing)
+    {
+      _mbsfn_cell.nof_prb = cell.mbsfn_prb;
+    }
+
+    srsran_cell_t _cell;
+    srsran_cell_t _mbsfn_cell;
+    uint8_t _area_id;
+    srsran_scs_t _scs;
+};
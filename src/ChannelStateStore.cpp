@@ -0,0 +1,147 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ChannelStateStore.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+static const uint32_t kTtiWrap = 10240;
+
+/**
+ *  TTIs from since to tti, modulo the TTI wrap
+ */
+static uint32_t tti_age(uint32_t tti, uint32_t since) {
+  return (tti + kTtiWrap - since) % kTtiWrap;
+}
+
+ChannelStateStore::ChannelStateStore(const libconfig::Config& cfg) {
+  cfg.lookupValue("modem.phy.channel_estimate_reuse.enabled", _enabled);
+  cfg.lookupValue("modem.phy.channel_estimate_reuse.new_estimate_weight", _new_weight);
+  cfg.lookupValue("modem.phy.channel_estimate_reuse.max_age_ms", _max_age);
+  _new_weight = std::min(std::max(_new_weight, 0.0F), 1.0F);
+
+  // Each processor reads one estimate and fills another at a time, and one is published
+  unsigned processors = 4;
+  cfg.lookupValue("modem.phy.threads", processors);
+  _estimates = std::make_unique<JobSlots<estimate_t>>(2 * processors + 2);
+  if (_enabled) {
+    spdlog::info("Filtering MBSFN channel estimates over time, new estimate weight {}, max age {} ms", _new_weight, _max_age);
+  }
+}
+
+void ChannelStateStore::blend(const std::shared_ptr<const CellContext>& context, int antenna, uint32_t tti, cf_t* const* ce, unsigned rx_channels) {
+  auto nof_re = context->re_per_subframe();
+
+  // The new estimate's slot doubles as scratch space while blending
+  auto next = _estimates->acquire();
+  if (next == nullptr) {
+    return;
+  }
+  if (next->ce.size() != rx_channels || next->ce[0].size() != nof_re) {
+    // Only happens for the first estimates after a new cell, area or numerology
+    next->ce.resize(rx_channels);
+    for (auto& ch : next->ce) {
+      ch.resize(nof_re);
+    }
+  }
+
+  bool older = false;
+  auto latest = acquire_latest();
+  if (latest != nullptr && latest->matches(context, antenna, rx_channels)) {
+    auto age = tti_age(tti, latest->tti);
+    bool newer = age > 0 && age <= _max_age;
+    older = age > 0 && kTtiWrap - age <= _max_age;
+    if (newer || older) {
+      for (auto ch = 0U; ch < rx_channels; ch++) {
+        // ce = w * ce + (1 - w) * stored
+        srsran_vec_sc_prod_cfc(latest->ce[ch].data(), 1.0F - _new_weight, next->ce[ch].data(), nof_re);
+        srsran_vec_sc_prod_cfc(ce[ch], _new_weight, ce[ch], nof_re);
+        srsran_vec_sum_ccc(ce[ch], next->ce[ch].data(), ce[ch], nof_re);
+      }
+    }
+  }
+  if (latest != nullptr) {
+    release(latest);
+  }
+
+  // Completed out of order: the stored estimate is newer and must stay as it is
+  if (older) {
+    release(next);
+    return;
+  }
+
+  for (auto ch = 0U; ch < rx_channels; ch++) {
+    srsran_vec_cf_copy(next->ce[ch].data(), ce[ch], nof_re);
+  }
+  next->context = context;
+  next->antenna = antenna;
+  next->tti = tti;
+  if (!publish(next)) {
+    release(next);
+  }
+}
+
+auto ChannelStateStore::acquire_latest() -> estimate_t* {
+  for (;;) {
+    auto latest = _latest.load();
+    if (latest == nullptr) {
+      return nullptr;
+    }
+    // The slot may have been replaced and reused since it was loaded. Once referenced, it can not be
+    // reused anymore, so it is safe to read if it is still the published one. All of this is
+    // sequentially consistent: the check must not see a stale pointer once the slot is reused.
+    latest->refs.fetch_add(1);
+    if (_latest.load() == latest) {
+      return latest;
+    }
+    release(latest);
+  }
+}
+
+void ChannelStateStore::release(estimate_t* estimate) {
+  estimate->refs.fetch_sub(1);
+}
+
+auto ChannelStateStore::publish(estimate_t* estimate) -> bool {
+  for (;;) {
+    auto current = acquire_latest();
+    if (current != nullptr && current->matches(estimate->context, estimate->antenna, static_cast<unsigned>(estimate->ce.size()))) {
+      // Another processor has published an estimate for a later subframe in the meantime
+      auto age = tti_age(current->tti, estimate->tti);
+      if (age > 0 && age <= _max_age) {
+        release(current);
+        return false;
+      }
+    }
+    auto expected = current;
+    if (_latest.compare_exchange_strong(expected, estimate)) {
+      if (current != nullptr) {
+        // The reference taken above, and the one the store held while it was published
+        release(current);
+        release(current);
+      }
+      return true;
+    }
+    if (current != nullptr) {
+      release(current);
+    }
+  }
+}
@@ -0,0 +1,94 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <libconfig.h++>
+#include "srsran/srsran.h"
+#include "CellContext.h"
+#include "JobSlots.h"
+
+/**
+ *  Channel estimate shared by all MBSFN processors, for filtering the estimate over time.
+ *
+ *  Consecutive MBSFN subframes are processed by different processors, so each of them only sees the
+ *  pilots of its own subframe. For fixed receivers the channel barely changes from one subframe to the
+ *  next, and averaging the estimate with the one of the preceding subframes lowers its noise.
+ *
+ *  The store keeps the most recent (filtered) estimate together with its TTI, the cell context and the
+ *  antenna it was made from. blend() averages a new estimate with it, if it is recent enough and was made
+ *  for the same cell context and antenna selection, and keeps the result for the next subframe. Subframes
+ *  that complete out of order are filtered, but do not replace a newer estimate.
+ *
+ *  Estimates are immutable once published. They live in preallocated, reference counted slots, so
+ *  processors read and publish them without taking a lock.
+ */
+class ChannelStateStore {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     */
+    explicit ChannelStateStore(const libconfig::Config& cfg);
+
+    /**
+     *  Returns true if channel estimates are to be filtered over time
+     */
+    bool enabled() const { return _enabled; }
+
+    /**
+     *  Filter a channel estimate with the stored one, in place, and store the result.
+     *
+     *  @param context Cell context the estimate was made with
+     *  @param antenna Antenna the estimate was made from, or AntennaSelector::kAllAntennas if combined
+     *  @param tti TTI of the subframe the estimate belongs to
+     *  @param ce Channel estimates, one per receive channel, covering the resource grid of the subframe
+     *  @param rx_channels Nr of receive channels
+     */
+    void blend(const std::shared_ptr<const CellContext>& context, int antenna, uint32_t tti, cf_t* const* ce, unsigned rx_channels);
+
+  private:
+    struct estimate_t {
+      std::atomic<unsigned> refs = {0};  /**< One held by the store while published, one per reader */
+      std::shared_ptr<const CellContext> context;
+      int antenna = 0;
+      uint32_t tti = 0;
+      std::vector<std::vector<cf_t>> ce;
+
+      bool matches(const std::shared_ptr<const CellContext>& other_context, int other_antenna, unsigned rx_channels) const {
+        return context == other_context && antenna == other_antenna && ce.size() == rx_channels;
+      }
+    };
+
+    estimate_t* acquire_latest();
+    static void release(estimate_t* estimate);
+    bool publish(estimate_t* estimate);
+
+    bool _enabled = false;
+    float _new_weight = 0.5;
+    uint32_t _max_age = 10;
+
+    std::unique_ptr<JobSlots<estimate_t>> _estimates;
+    std::atomic<estimate_t*> _latest = {nullptr};
+};
@@ -0,0 +1,233 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "CodeblockDecoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+
+#include "spdlog/spdlog.h"
+#include "thread_pool.hpp"
+
+/**
+ *  State of one TB decode, shared between the caller and its helpers. Helpers that
+ *  start after all code blocks have been taken return without touching the LLRs.
+ */
+struct CodeblockDecoder::job_t {
+  srsran_pdsch_cfg_t cfg = {};
+  int16_t* e_bits = nullptr;
+  srsran_softbuffer_rx_t* target = nullptr;
+  srsran_cbsegm_t cb_segm = {};
+
+  std::atomic<uint32_t> next = {0};
+  std::atomic<uint32_t> done = {0};
+  std::atomic<uint32_t> failed = {0};
+  std::atomic<unsigned> refs = {0};
+
+  float iterations = 0;  /**< Sum of srsran_sch_last_noi() after each code block, guarded by mutex */
+  std::mutex mutex;
+  std::condition_variable finished;
+};
+
+CodeblockDecoder::CodeblockDecoder(const libconfig::Config& cfg, thread_pool& pool)
+  : _pool(pool)
+{
+  cfg.lookupValue("modem.phy.parallel_codeblock_decoding", _enabled);
+}
+
+CodeblockDecoder::~CodeblockDecoder() {
+  for (auto ctx : _contexts) {
+    srsran_sch_free(&ctx->sch);
+    srsran_softbuffer_rx_free(&ctx->softbuffer);
+    free(ctx->data);  // NOLINT
+    delete ctx;
+  }
+}
+
+auto CodeblockDecoder::init() -> bool {
+  if (!_enabled) {
+    return true;
+  }
+
+  // One job per pool thread decoding, plus room for helpers still queued for finished ones
+  _jobs = std::make_unique<JobSlots<job_t>>(4 * _pool.thread_count());
+
+  // Every participant in a decode runs on a pool thread, so one context per thread is always enough
+  for (auto i = 0U; i < _pool.thread_count(); i++) {
+    auto ctx = new context_t{};
+    _contexts.push_back(ctx);
+    if (srsran_sch_init_rx(&ctx->sch) != SRSRAN_SUCCESS) {
+      spdlog::error("Could not init code block decoder");
+      return false;
+    }
+    // The softbuffer is allocated in set_cell(), once the bandwidth is known
+    ctx->data = srsran_vec_u8_malloc(SRSRAN_MAX_BUFFER_SIZE_BYTES);
+    if (!ctx->data) {
+      spdlog::error("Could not allocate code block decoder buffer");
+      return false;
+    }
+    _free_contexts.push_back(ctx);
+  }
+  spdlog::info("Parallel code block decoding enabled with {} decoder contexts", _contexts.size());
+  return true;
+}
+
+auto CodeblockDecoder::set_cell(uint32_t nof_prb) -> bool {
+  if (!_enabled || nof_prb == _nof_prb) {
+    return true;
+  }
+  _nof_prb = 0;
+  _max_cb = 0;
+  for (auto ctx : _contexts) {
+    srsran_softbuffer_rx_free(&ctx->softbuffer);
+    if (srsran_softbuffer_rx_init(&ctx->softbuffer, nof_prb) != SRSRAN_SUCCESS) {
+      spdlog::error("Could not init code block decoder softbuffer");
+      return false;
+    }
+  }
+  _nof_prb = nof_prb;
+  _max_cb = _contexts.empty() ? 0 : _contexts[0]->softbuffer.max_cb;
+  return true;
+}
+
+auto CodeblockDecoder::parallelize(const srsran_pdsch_cfg_t& cfg) -> bool {
+  if (!_enabled || cfg.grant.tb[0].tbs <= 0) {
+    return false;
+  }
+  srsran_cbsegm_t cb_segm = {};
+  if (srsran_cbsegm(&cb_segm, static_cast<uint32_t>(cfg.grant.tb[0].tbs)) != SRSRAN_SUCCESS || cb_segm.C > _max_cb) {
+    return false;
+  }
+  return cb_segm.C > 1;
+}
+
+auto CodeblockDecoder::decode(const srsran_pdsch_cfg_t& cfg, int16_t* e_bits, float& avg_iterations) -> unsigned {
+  // If all job slots are taken, the TB is decoded without helpers, using state no one else can see
+  static thread_local job_t local_job;
+  auto job = _jobs->acquire();
+  if (job == nullptr) {
+    job = &local_job;
+  }
+  job->cfg = cfg;
+  job->e_bits = e_bits;
+  job->target = cfg.softbuffers.rx[0];
+  srsran_cbsegm(&job->cb_segm, static_cast<uint32_t>(cfg.grant.tb[0].tbs));
+  job->next = 0;
+  job->done = 0;
+  job->failed = 0;
+  job->iterations = 0;
+
+  uint32_t nof_cb = job->cb_segm.C;
+  for (auto i = 0U; i < nof_cb; i++) {
+    job->target->cb_crc[i] = false;
+  }
+
+  // Only idle workers are asked to help. Busy ones would pick the task up late and find nothing left to do.
+  auto idle = job != &local_job ? _pool.thread_count() - std::min(_pool.thread_count(), _pool.active_count()) : 0;
+  auto helpers = std::min(static_cast<size_t>(nof_cb - 1), idle);
+  for (auto h = 0U; h < helpers; h++) {
+    JobSlots<job_t>::retain(job);
+    _pool.post([this, job] {
+      run(*job);
+      JobSlots<job_t>::release(job);
+    });
+  }
+
+  run(*job);
+
+  uint32_t failed = 0;
+  {
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [job, nof_cb] { return job->done.load() == nof_cb; });
+    failed = job->failed.load();
+    avg_iterations = job->iterations / static_cast<float>(nof_cb);
+  }
+  if (job != &local_job) {
+    JobSlots<job_t>::release(job);
+  }
+  return failed;
+}
+
+void CodeblockDecoder::run(job_t& job) {
+  auto ctx = acquire_context();
+  if (ctx == nullptr) {
+    return;
+  }
+
+  uint32_t nof_cb = job.cb_segm.C;
+  for (;;) {
+    auto cb_idx = job.next.fetch_add(1);
+    if (cb_idx >= nof_cb) {
+      break;
+    }
+    if (!decode_codeblock(ctx, job, cb_idx)) {
+      job.failed++;
+    }
+    const std::lock_guard<std::mutex> lock(job.mutex);
+    job.iterations += srsran_sch_last_noi(&ctx->sch);
+    if (job.done.fetch_add(1) + 1 == nof_cb) {
+      job.finished.notify_all();
+    }
+  }
+  release_context(ctx);
+}
+
+auto CodeblockDecoder::decode_codeblock(context_t* ctx, job_t& job, uint32_t cb_idx) -> bool {
+  // Mark all other code blocks as already decoded, so srsran runs rate matching and the
+  // turbo decoder for this one only. The TB CRC of this pass is meaningless and ignored.
+  // Only the soft bits of this code block are cleared: resetting the whole softbuffer would
+  // clear those of all code blocks for every one of them.
+  uint32_t cb_len = cb_idx < job.cb_segm.C2 ? job.cb_segm.K2 : job.cb_segm.K1;
+  memset(ctx->softbuffer.buffer_f[cb_idx], 0, (3 * cb_len + 12) * sizeof(int16_t));
+  ctx->softbuffer.tb_crc = false;
+  for (auto i = 0U; i < job.cb_segm.C; i++) {
+    ctx->softbuffer.cb_crc[i] = (i != cb_idx);
+  }
+
+  srsran_pdsch_cfg_t cfg = job.cfg;
+  cfg.softbuffers.rx[0] = &ctx->softbuffer;
+  srsran_dlsch_decode(&ctx->sch, &cfg, job.e_bits, ctx->data);
+
+  if (!ctx->softbuffer.cb_crc[cb_idx]) {
+    return false;
+  }
+
+  memcpy(job.target->data[cb_idx], ctx->softbuffer.data[cb_idx], cb_len / 8);
+  job.target->cb_crc[cb_idx] = true;
+  return true;
+}
+
+auto CodeblockDecoder::acquire_context() -> context_t* {
+  const std::lock_guard<std::mutex> lock(_contexts_mutex);
+  if (_free_contexts.empty()) {
+    spdlog::warn("No free code block decoder context");
+    return nullptr;
+  }
+  auto ctx = _free_contexts.back();
+  _free_contexts.pop_back();
+  return ctx;
+}
+
+void CodeblockDecoder::release_context(context_t* ctx) {
+  const std::lock_guard<std::mutex> lock(_contexts_mutex);
+  _free_contexts.push_back(ctx);
+}
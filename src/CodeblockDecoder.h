@@ -0,0 +1,114 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <libconfig.h++>
+#include "srsran/srsran.h"
+#include "JobSlots.h"
+
+class thread_pool;
+
+/**
+ *  Decodes the turbo code blocks of a transport block in parallel.
+ *
+ *  srsran decodes all code blocks of a TB one after another. This decoder hands the
+ *  code blocks out to idle workers of the PHY thread pool, each using its own decoder context,
+ *  and collects the results in the caller's softbuffer. Every code block that passed its own CRC
+ *  is marked in the softbuffer, so srsran can afterwards assemble the TB and check the TB CRC
+ *  without running the turbo decoder again.
+ */
+class CodeblockDecoder {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param pool PHY thread pool to run helpers on
+     */
+    CodeblockDecoder(const libconfig::Config& cfg, thread_pool& pool);
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~CodeblockDecoder();
+
+    /**
+     *  Allocate one decoder context per pool thread.
+     *  Must be called once before the first call to decode().
+     */
+    bool init();
+
+    /**
+     *  Size the softbuffers of the decoder contexts for the MBSFN bandwidth of a cell.
+     *  Must not be called while a TB is being decoded.
+     *
+     *  @param nof_prb Nr of PRB of the MBSFN processors
+     */
+    bool set_cell(uint32_t nof_prb);
+
+    /**
+     *  Returns true if the TB of the grant in cfg has enough code blocks to be decoded in parallel.
+     *  TBs with more code blocks than the softbuffers of the contexts hold are left to srsran.
+     */
+    bool parallelize(const srsran_pdsch_cfg_t& cfg);
+
+    /**
+     *  Decode all code blocks of TB 0.
+     *
+     *  The results are written to the softbuffer referenced by cfg.softbuffers.rx[0]. The caller
+     *  participates in decoding, so this never waits for a busy worker.
+     *
+     *  @param cfg PDSCH config of the PMCH grant
+     *  @param e_bits Descrambled LLRs of the TB
+     *  @param avg_iterations Set to the mean turbo decoder iterations per code block
+     *  @return Number of code blocks that failed their CRC
+     */
+    unsigned decode(const srsran_pdsch_cfg_t& cfg, int16_t* e_bits, float& avg_iterations);
+
+  private:
+    typedef struct {
+      srsran_sch_t sch;
+      srsran_softbuffer_rx_t softbuffer;
+      uint8_t* data;
+    } context_t;
+
+    struct job_t;
+
+    void run(job_t& job);
+    bool decode_codeblock(context_t* ctx, job_t& job, uint32_t cb_idx);
+
+    context_t* acquire_context();
+    void release_context(context_t* ctx);
+
+    thread_pool& _pool;
+    bool _enabled = true;
+    uint32_t _nof_prb = 0;
+    uint32_t _max_cb = 0;  /**< Code blocks the context softbuffers hold */
+
+    std::unique_ptr<JobSlots<job_t>> _jobs;
+
+    std::vector<context_t*> _contexts;
+    std::vector<context_t*> _free_contexts;
+    std::mutex _contexts_mutex;
+};
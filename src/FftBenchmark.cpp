@@ -0,0 +1,170 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FftBenchmark.h"
+
+#include <fftw3.h>
+
+#include <chrono>
+#include <random>
+
+#include "CellContext.h"
+#include "spdlog/spdlog.h"
+
+static const uint32_t kBenchmarkPrb[] = {25, 50, 75, 100};  // NOLINT
+
+template <class F>
+static auto average_us(unsigned iterations, F&& f) -> double {
+  for (auto i = 0U; i < 10; i++) {
+    f(i);
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0U; i < iterations; i++) {
+    f(i);
+  }
+  auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+  return elapsed.count() / iterations;
+}
+
+static void fill_noise(cf_t* buffer, uint32_t samples) {
+  std::mt19937 gen(1);
+  std::normal_distribution<float> dist(0.0F, 0.1F);
+  for (auto i = 0U; i < samples; i++) {
+    __real__ buffer[i] = dist(gen);
+    __imag__ buffer[i] = dist(gen);
+  }
+}
+
+auto FftBenchmark::run() -> bool {
+  spdlog::info("MBSFN OFDM demodulation benchmark, {} RX channel(s), {} subframes per measurement", _rx_channels, _iterations);
+  for (auto nof_prb : kBenchmarkPrb) {
+    for (auto scs : CellContext::kSubcarrierSpacings) {
+      double ue_dl_us = 0;
+      if (!measure_ue_dl(nof_prb, scs, &ue_dl_us)) {
+        return false;
+      }
+
+      auto fft_size = CellContext::fft_size_factor(scs) * static_cast<uint32_t>(srsran_symbol_sz(nof_prb));
+      auto nof_ffts = CellContext::symbols_per_subframe(scs) * _rx_channels;
+      double per_symbol_us = 0;
+      double batched_us = 0;
+      if (!measure_fft(fft_size, nof_ffts, &per_symbol_us, &batched_us)) {
+        return false;
+      }
+
+      spdlog::info("{:3} PRB, SCS {:5.2f} kHz: FFT+CE {:8.1f} us/sf | {:2} x {:6}-point FFT: per symbol {:7.1f} us, batched {:7.1f} us ({:.2f}x)",
+          nof_prb, 15.0 / CellContext::fft_size_factor(scs), ue_dl_us, nof_ffts, fft_size,
+          per_symbol_us, batched_us, batched_us > 0 ? per_symbol_us / batched_us : 0.0);
+    }
+  }
+  return true;
+}
+
+auto FftBenchmark::measure_ue_dl(uint32_t nof_prb, srsran_scs_t subcarrier_spacing, double* us) -> bool {
+  cf_t* buffers[SRSRAN_MAX_PORTS] = {};
+  uint32_t samples = 3 * SRSRAN_SF_LEN_PRB(nof_prb);
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    buffers[ch] = srsran_vec_cf_malloc(samples);
+    if (!buffers[ch]) {
+      spdlog::error("Could not allocate benchmark buffer");
+      return false;
+    }
+    fill_noise(buffers[ch], samples);
+  }
+
+  bool ok = false;
+  srsran_ue_dl_t ue_dl = {};
+  if (srsran_ue_dl_init(&ue_dl, buffers, nof_prb, _rx_channels) == 0) {
+    srsran_cell_t cell = {};
+    cell.id = 1;
+    cell.nof_prb = nof_prb;
+    cell.mbsfn_prb = nof_prb;
+    cell.nof_ports = 1;
+    cell.cp = SRSRAN_CP_EXT;
+    cell.mbms_dedicated = true;
+    srsran_ue_dl_set_cell(&ue_dl, cell);
+    srsran_ue_dl_set_mbsfn_subcarrier_spacing(&ue_dl, subcarrier_spacing);
+    srsran_ue_dl_set_mbsfn_area_id(&ue_dl, 1);
+
+    srsran_ue_dl_cfg_t ue_dl_cfg = {};
+    ue_dl_cfg.chest_cfg.filter_coef[0] = 0.1;
+    ue_dl_cfg.chest_cfg.filter_type = SRSRAN_CHEST_FILTER_TRIANGLE;
+    ue_dl_cfg.chest_cfg.noise_alg = SRSRAN_NOISE_ALG_EMPTY;
+    ue_dl_cfg.chest_cfg.estimator_alg = SRSRAN_ESTIMATOR_ALG_INTERPOLATE;
+    ue_dl_cfg.chest_cfg.mbsfn_area_id = 1;
+
+    srsran_dl_sf_cfg_t sf_cfg = {};
+    sf_cfg.sf_type = SRSRAN_SF_MBSFN;
+    sf_cfg.subcarrier_spacing = subcarrier_spacing;
+
+    *us = average_us(_iterations, [&](unsigned i) {
+        sf_cfg.tti = 1 + (i % 9);
+        srsran_ue_dl_decode_fft_estimate(&ue_dl, &sf_cfg, &ue_dl_cfg);
+    });
+    ok = true;
+    srsran_ue_dl_free(&ue_dl);
+  } else {
+    spdlog::error("Could not init ue_dl for {} PRB", nof_prb);
+  }
+
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    free(buffers[ch]);  // NOLINT
+  }
+  return ok;
+}
+
+auto FftBenchmark::measure_fft(uint32_t fft_size, uint32_t nof_ffts, double* per_symbol_us, double* batched_us) -> bool {
+  auto n = static_cast<int>(fft_size);
+  auto in = static_cast<fftwf_complex*>(fftwf_malloc(sizeof(fftwf_complex) * fft_size * nof_ffts));
+  auto out = static_cast<fftwf_complex*>(fftwf_malloc(sizeof(fftwf_complex) * fft_size * nof_ffts));
+  if (!in || !out) {
+    fftwf_free(in);
+    fftwf_free(out);
+    spdlog::error("Could not allocate FFT benchmark buffers");
+    return false;
+  }
+
+  // Same planner flags as srsran
+  auto single = fftwf_plan_dft_1d(n, in, out, FFTW_FORWARD, FFTW_MEASURE);
+  auto batched = fftwf_plan_many_dft(1, &n, static_cast<int>(nof_ffts),
+      in, nullptr, 1, n,
+      out, nullptr, 1, n,
+      FFTW_FORWARD, FFTW_MEASURE);
+  fill_noise(reinterpret_cast<cf_t*>(in), fft_size * nof_ffts);  // NOLINT
+
+  if (single && batched) {
+    *per_symbol_us = average_us(_iterations, [&](unsigned /*i*/) {
+        for (auto s = 0U; s < nof_ffts; s++) {
+          fftwf_execute_dft(single, in + s * fft_size, out + s * fft_size);
+        }
+    });
+    *batched_us = average_us(_iterations, [&](unsigned /*i*/) { fftwf_execute(batched); });
+  }
+
+  bool ok = single && batched;
+  if (single) {
+    fftwf_destroy_plan(single);
+  }
+  if (batched) {
+    fftwf_destroy_plan(batched);
+  }
+  fftwf_free(in);
+  fftwf_free(out);
+  return ok;
+}
@@ -0,0 +1,58 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+#include "srsran/srsran.h"
+
+/**
+ *  Benchmark of the MBSFN OFDM demodulation for all subcarrier spacings and bandwidths.
+ *
+ *  For every combination, measures the time srsran_ue_dl_decode_fft_estimate takes per MBSFN subframe,
+ *  and compares the raw FFT cost of transforming the subframe's symbols for all antennas one at a time
+ *  with a single batched FFTW plan_many call. Run with the --fft-benchmark command line option.
+ *
+ *  The batched transform only exists in this benchmark. The MBSFN processors still demodulate through
+ *  srsran's ofdm module, which uses one FFTW plan per slot and antenna.
+ */
+class FftBenchmark {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param rx_channels Nr of receive antennas
+     *  @param iterations Nr of subframes to average over
+     */
+    FftBenchmark(unsigned rx_channels, unsigned iterations)
+      : _rx_channels(rx_channels)
+      , _iterations(iterations) {}
+
+    /**
+     *  Run the benchmark and log the results. Returns false if a measurement could not be set up.
+     */
+    bool run();
+
+  private:
+    bool measure_ue_dl(uint32_t nof_prb, srsran_scs_t subcarrier_spacing, double* us);
+    bool measure_fft(uint32_t fft_size, uint32_t nof_ffts, double* per_symbol_us, double* batched_us);
+
+    unsigned _rx_channels;
+    unsigned _iterations;
+};
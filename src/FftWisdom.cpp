@@ -0,0 +1,125 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "FftWisdom.h"
+
+#include <fftw3.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include "CellContext.h"
+#include "ParallelFft.h"
+#include "srsran/srsran.h"
+#include "spdlog/spdlog.h"
+
+FftWisdom::FftWisdom(const libconfig::Config& cfg) {
+  cfg.lookupValue("modem.phy.fftw_wisdom.enabled", _enabled);
+  cfg.lookupValue("modem.phy.fftw_wisdom.file", _file);
+}
+
+FftWisdom::~FftWisdom() {
+  if (_planner.joinable()) {
+    _planner.join();
+  }
+  save();
+}
+
+void FftWisdom::load() {
+  if (!_enabled) {
+    return;
+  }
+  if (fftwf_import_wisdom_from_filename(_file.c_str()) != 0) {
+    spdlog::info("Loaded FFTW wisdom from {}", _file);
+    std::unique_ptr<char, decltype(&free)> wisdom(fftwf_export_wisdom_to_string(), &free);
+    if (wisdom) {
+      _saved = wisdom.get();
+    }
+  } else {
+    spdlog::info("No FFTW wisdom loaded from {}, FFTs will be planned from scratch", _file);
+  }
+}
+
+void FftWisdom::plan(uint32_t nof_prb) {
+  if (!_enabled || _planned_prb == nof_prb) {
+    return;
+  }
+  if (_planner.joinable()) {
+    _planner.join();
+  }
+  _planned_prb = nof_prb;
+  _planner = std::thread([this, nof_prb] { plan_sizes(nof_prb); });
+}
+
+void FftWisdom::plan_sizes(uint32_t nof_prb) {
+  auto started = std::chrono::steady_clock::now();
+  auto symbol_sz = srsran_symbol_sz(nof_prb);
+  if (symbol_sz <= 0) {
+    return;
+  }
+
+  for (auto scs : CellContext::kSubcarrierSpacings) {
+    auto size = static_cast<int>(CellContext::fft_size_factor(scs)) * symbol_sz;
+    const std::lock_guard<std::mutex> lock(_mutex);
+    // Planned with the thread count the MBSFN processors use, so their plans find this wisdom.
+    // The plan is discarded, FFTW keeps the wisdom.
+    const ParallelFft::Planning planning;
+    srsran_dft_plan_t plan = {};
+    if (srsran_dft_plan_c(&plan, size, SRSRAN_DFT_FORWARD) != SRSRAN_SUCCESS) {
+      spdlog::warn("Could not plan FFT of size {}", size);
+      continue;
+    }
+    srsran_dft_plan_free(&plan);
+  }
+  spdlog::info("Planned FFTs for {} PRB in {} ms", nof_prb,
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count());
+}
+
+void FftWisdom::save(bool wait) {
+  if (!_enabled) {
+    return;
+  }
+  std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+  if (wait) {
+    lock.lock();
+  } else if (!lock.try_lock()) {
+    spdlog::debug("Not saving FFTW wisdom while FFTs are being planned");
+    return;
+  }
+  std::unique_ptr<char, decltype(&free)> wisdom(fftwf_export_wisdom_to_string(), &free);
+  if (!wisdom || _saved == wisdom.get()) {
+    return;
+  }
+
+  auto dir = _file.substr(0, _file.find_last_of('/'));
+  if (!dir.empty() && dir != _file) {
+    mkdir(dir.c_str(), 0755);  // NOLINT
+  }
+  // Only retried once there is new wisdom
+  _saved = wisdom.get();
+  if (fftwf_export_wisdom_to_filename(_file.c_str()) == 0) {
+    spdlog::warn("Could not write FFTW wisdom to {}: {}", _file, strerror(errno));
+    return;
+  }
+  spdlog::info("Saved FFTW wisdom to {}", _file);
+}
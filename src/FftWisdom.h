@@ -0,0 +1,84 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <libconfig.h++>
+
+/**
+ *  Persistent FFTW wisdom, and background planning of the FFT sizes used by the FeMBMS numerologies.
+ *
+ *  The FFTs for the 7.5, 2.5, 1.25 and 0.37 kHz subcarrier spacings are large, and planning
+ *  them when the first MBSFN subframe arrives stalls the main loop. Wisdom is loaded from a file at
+ *  startup, and plan() creates plans for all sizes a cell may need in the background while searching
+ *  and syncing, so srsran finds the wisdom when it plans them for real. New wisdom is written back
+ *  once the frame processors have been set up for a cell, and at shutdown.
+ */
+class FftWisdom {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     */
+    explicit FftWisdom(const libconfig::Config& cfg);
+
+    /**
+     *  Default destructor. Waits for background planning to finish, and saves the wisdom.
+     */
+    virtual ~FftWisdom();
+
+    /**
+     *  Import the wisdom file. Must be called before any FFT is planned.
+     */
+    void load();
+
+    /**
+     *  Start planning the FFT sizes of all subcarrier spacings for nof_prb in the background.
+     *  Does nothing if these sizes have already been planned.
+     */
+    void plan(uint32_t nof_prb);
+
+    /**
+     *  Write the wisdom file if new wisdom has been gathered since it was last written.
+     *
+     *  Exporting wisdom is not thread safe against FFTW planning, which srsran does without our lock
+     *  when the frame processors are configured. Only call this while no frame processor is being set up.
+     *
+     *  @param wait Wait for the background planner to finish its current size. If false, nothing is
+     *              saved while it is planning.
+     */
+    void save(bool wait = true);
+
+  private:
+    void plan_sizes(uint32_t nof_prb);
+
+    bool _enabled = true;
+    std::string _file = "/var/lib/5gmag-rt/fftw_wisdom";
+    std::string _saved;
+
+    std::thread _planner;
+    std::atomic<uint32_t> _planned_prb = {0};
+    std::mutex _mutex;  /**< Serializes background planning and wisdom export */
+};
@@ -30,104 +30,463 @@
 
 #include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <cstdint>
 
 #include "spdlog/spdlog.h"
 
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103  // linux/udp.h, not exposed by older libc headers
+#endif
+
+Gw::Gw(const libconfig::Config& cfg, Phy& phy, RestHandler& rest)
+  : _phy(phy)
+  , _rest(rest)
+{
+  cfg.lookupValue("modem.gw.output_queue_size", _queue_size);
+  cfg.lookupValue("modem.gw.output_queues", _nof_outputs);
+  _nof_outputs = std::max(_nof_outputs, 1U);
+  std::string output = "tun";
+  cfg.lookupValue("modem.gw.output", output);
+  _udp_output = (output == "udp");
+  cfg.lookupValue("modem.gw.udp.interface", _udp_interface);
+  cfg.lookupValue("modem.gw.udp.ttl", _udp_ttl);
+  cfg.lookupValue("modem.gw.udp.segmentation_offload", _udp_gso);
+
+  // Round up to a power of two, so positions wrap with a mask
+  size_t size = 2;
+  while (size < _queue_size) {
+    size <<= 1U;
+  }
+  for (auto o = 0U; o < _nof_outputs; o++) {
+    auto out = std::make_unique<output_t>();
+    out->queue_mask = size - 1;
+    out->queue.reset(new cell_t[size]);  // NOLINT
+    for (auto i = 0U; i < size; i++) {
+      out->queue[i].seq.store(i, std::memory_order_relaxed);
+      out->queue[i].pdu = nullptr;
+    }
+    out->udp_gso = _udp_gso;
+    _outputs.push_back(std::move(out));
+  }
+}
+
 void Gw::write_pdu_mch(uint32_t mch_idx, uint32_t lcid, srsran::unique_byte_buffer_t pdu) {
-  char* err_str = nullptr;
-  if (pdu->N_bytes > 2) {
-    spdlog::debug("GW: RX MCH PDU ({} B), MCH idx {}. Stack latency: {} us", pdu->N_bytes, mch_idx,  pdu->get_latency_us().count());
+  if (pdu->N_bytes <= 2) {
+    return;
+  }
+  // All PDUs of an MCH go through the same queue, to keep them in order
+  auto& out = *_outputs[mch_idx % _nof_outputs];
+  if (!push(out, pdu, mch_idx, lcid)) {
+    _rest._gw.drops++;
+    return;
+  }
 
-    if (_tun_fd < 0) {
-      spdlog::warn("TUN/TAP not up - dropping gw RX message\n");
-    } else {
-      auto ip_hdr = reinterpret_cast<iphdr*>(pdu->msg);
-      if (ip_hdr->protocol == 17 /*UDP*/) {
-        auto udp_hdr = reinterpret_cast<udphdr*>(pdu->msg + 4UL * ip_hdr->ihl);
-        char dest[INET6_ADDRSTRLEN] = "";   // NOLINT
-        inet_ntop(AF_INET, (const void*)&ip_hdr->daddr, dest, sizeof(dest));
-
-        _phy.set_dest_for_lcid(mch_idx, static_cast<int>(lcid), std::string(dest) + ":" + std::to_string(ntohs(udp_hdr->dest)));
-
-        auto ptr = reinterpret_cast<uint16_t*>(ip_hdr);
-        int32_t sum = 0;
-        sum += *ptr++;   // ihl / version / dscp
-        sum += *ptr++;   // total len
-        sum += *ptr++;   // id
-        sum += *ptr++;   // frag offset
-        sum += *ptr++;   // ttl + protocol
-        ptr++;           // skip checksum
-        sum += *ptr++;   // src
-        sum += *ptr++;   // src
-        sum += *ptr++;   // dst
-        sum += *ptr;     // dst
-
-        sum = (sum >> 16) + (sum & 0xffff);
-        sum += (sum >> 16);
-
-        uint16_t chk = ~sum;
-        if (ip_hdr->check != chk) {
-          spdlog::info("Wrong IP header checksum {}, should be {}. Correcting.", ip_hdr->check, chk);
-          ip_hdr->check = chk;
-        }
+  // Wake the output thread if it is about to sleep or sleeping. The fence pairs with the one in output(),
+  // so either the output thread sees the new packet or this sees it sleeping.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (out.sleeping.load(std::memory_order_relaxed)) {
+    const std::lock_guard<std::mutex> lock(out.wakeup_mutex);
+    out.sleeping.store(false, std::memory_order_relaxed);
+    out.wakeup.notify_one();
+  }
+}
+
+auto Gw::push(output_t& out, srsran::unique_byte_buffer_t& pdu, uint32_t mch_idx, uint32_t lcid) -> bool {
+  // Bounded MPSC queue: producers claim a cell by advancing the enqueue position, and publish it through
+  // its sequence number. A cell is free for position pos if its sequence number equals pos.
+  auto pos = out.enqueue_pos.load(std::memory_order_relaxed);
+  cell_t* cell = nullptr;
+  for (;;) {
+    cell = &out.queue[pos & out.queue_mask];
+    auto seq = cell->seq.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (out.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
       }
+    } else if (diff < 0) {
+      return false;  // full
+    } else {
+      pos = out.enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+  cell->pdu = pdu.release();
+  cell->mch_idx = mch_idx;
+  cell->lcid = lcid;
+  cell->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
 
-      _wr_mutex.lock();
-      auto n = write(_tun_fd, pdu->msg, pdu->N_bytes);
-      _wr_mutex.unlock();
+auto Gw::front(output_t& out) -> cell_t* {
+  auto pos = out.dequeue_pos.load(std::memory_order_relaxed);
+  auto cell = &out.queue[pos & out.queue_mask];
+  return cell->seq.load(std::memory_order_acquire) == pos + 1 ? cell : nullptr;
+}
 
-      if (n > 0L && (pdu->N_bytes != static_cast<uint32_t>(n))) {
-        spdlog::warn("DL TUN/TAP short write");
-      }
-      if (n == 0L) {
-        spdlog::warn("DL TUN/TAP 0 write");
+void Gw::pop(output_t& out) {
+  auto pos = out.dequeue_pos.load(std::memory_order_relaxed);
+  out.queue[pos & out.queue_mask].seq.store(pos + out.queue_mask + 1, std::memory_order_release);
+  out.dequeue_pos.store(pos + 1, std::memory_order_relaxed);
+}
+
+void Gw::output(output_t& out) {
+  while (_running.load(std::memory_order_relaxed)) {
+    // The depth is sampled when the thread wakes up, before it starts emptying the queue
+    auto depth = static_cast<uint32_t>(out.enqueue_pos.load(std::memory_order_relaxed) - out.dequeue_pos.load(std::memory_order_relaxed));
+    auto max = _rest._gw.max_depth.load(std::memory_order_relaxed);
+    while (depth > max && !_rest._gw.max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {}
+
+    unsigned batch = 0;
+    if (_udp_output) {
+      for (auto sent = send_udp(out); sent > 0; sent = send_udp(out)) {
+        batch += sent;
       }
-      if (n < 0L) {
-        err_str = strerror(errno);
-        spdlog::warn("DL TUN/TAP write error  {}", err_str);
+    } else {
+      for (auto cell = front(out); cell != nullptr; cell = front(out)) {
+        write_out(out, cell->pdu, cell->mch_idx, cell->lcid);
+        pop(out);
+        batch++;
       }
     }
+    if (batch > 0) {
+      _rest._gw.add_batch(batch);
+      _rest._gw.depth = depth;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(out.wakeup_mutex);
+    out.sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (front(out) != nullptr) {
+      out.sleeping.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    // The timeout only guards the shutdown flag, wakeups for new packets are never lost
+    out.wakeup.wait_for(lock, std::chrono::milliseconds(100), [&out] { return !out.sleeping.load(std::memory_order_relaxed); });
+    out.sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+void Gw::set_dest(output_t& out, uint32_t mch_idx, uint32_t lcid, uint32_t addr, uint16_t port) {
+  // Only changes are passed on, the PHY's destination table is shared by all output threads
+  auto& dest = out.dests[{mch_idx, lcid}];
+  if (dest.first != addr || dest.second != port) {
+    dest = {addr, port};
+    _phy.set_dest_for_lcid(mch_idx, static_cast<int>(lcid), addr, port);
+  }
+}
+
+auto Gw::ipv4_header_length(const srsran::byte_buffer_t& pdu) -> uint32_t {
+  // 0 if the PDU does not start with a complete IPv4 header
+  if (pdu.N_bytes < sizeof(iphdr)) {
+    return 0;
+  }
+  auto ip_hdr = reinterpret_cast<const iphdr*>(pdu.msg);
+  uint32_t len = 4U * ip_hdr->ihl;
+  if (ip_hdr->version != 4 || len < sizeof(iphdr) || len > pdu.N_bytes) {
+    return 0;
+  }
+  return len;
+}
+
+void Gw::write_out(output_t& out, srsran::byte_buffer_t* buffer, uint32_t mch_idx, uint32_t lcid) {
+  // Returned to the buffer pool when done
+  srsran::unique_byte_buffer_t pdu(buffer);
+  char* err_str = nullptr;
+  spdlog::debug("GW: RX MCH PDU ({} B), MCH idx {}. Stack latency: {} us", pdu->N_bytes, mch_idx,  pdu->get_latency_us().count());
+
+  if (out.tun_fd < 0) {
+    spdlog::warn("TUN/TAP not up - dropping gw RX message\n");
+    return;
+  }
+
+  auto ip_hdr = reinterpret_cast<iphdr*>(pdu->msg);
+  auto ip_hdr_len = ipv4_header_length(*pdu);
+  if (ip_hdr_len > 0 && ip_hdr->protocol == 17 /*UDP*/ && pdu->N_bytes >= ip_hdr_len + sizeof(udphdr)) {
+    auto udp_hdr = reinterpret_cast<udphdr*>(pdu->msg + ip_hdr_len);
+    set_dest(out, mch_idx, lcid, ip_hdr->daddr, ntohs(udp_hdr->dest));
+
+    auto ptr = reinterpret_cast<uint16_t*>(ip_hdr);
+    int32_t sum = 0;
+    sum += *ptr++;   // ihl / version / dscp
+    sum += *ptr++;   // total len
+    sum += *ptr++;   // id
+    sum += *ptr++;   // frag offset
+    sum += *ptr++;   // ttl + protocol
+    ptr++;           // skip checksum
+    sum += *ptr++;   // src
+    sum += *ptr++;   // src
+    sum += *ptr++;   // dst
+    sum += *ptr;     // dst
+
+    sum = (sum >> 16) + (sum & 0xffff);
+    sum += (sum >> 16);
+
+    uint16_t chk = ~sum;
+    if (ip_hdr->check != chk) {
+      spdlog::info("Wrong IP header checksum {}, should be {}. Correcting.", ip_hdr->check, chk);
+      ip_hdr->check = chk;
+    }
+  }
+
+  // A TUN device takes exactly one packet per write, so packets can not be coalesced into one syscall
+  auto n = write(out.tun_fd, pdu->msg, pdu->N_bytes);
+
+  if (n > 0L && (pdu->N_bytes != static_cast<uint32_t>(n))) {
+    spdlog::warn("DL TUN/TAP short write");
+  }
+  if (n == 0L) {
+    spdlog::warn("DL TUN/TAP 0 write");
+  }
+  if (n < 0L) {
+    err_str = strerror(errno);
+    spdlog::warn("DL TUN/TAP write error  {}", err_str);
+    _rest._gw.write_errors++;
+  } else {
+    _rest._gw.packets++;
   }
 }
 
 Gw::~Gw() {
-  if (_tun_fd != -1) {
-    close(_tun_fd);
+  _running = false;
+  for (auto& out : _outputs) {
+    if (!out->thread.joinable()) {
+      continue;
+    }
+    {
+      const std::lock_guard<std::mutex> lock(out->wakeup_mutex);
+      out->sleeping = false;
+    }
+    out->wakeup.notify_one();
+    out->thread.join();
+  }
+  for (auto& out : _outputs) {
+    // Return anything still queued to the buffer pool
+    for (auto cell = front(*out); cell != nullptr; cell = front(*out)) {
+      srsran::unique_byte_buffer_t pdu(cell->pdu);
+      pop(*out);
+    }
+    if (out->tun_fd != -1) {
+      close(out->tun_fd);
+    }
+    if (out->udp_fd != -1) {
+      close(out->udp_fd);
+    }
   }
 }
 
-void Gw::init() {
+auto Gw::send_udp(output_t& out) -> unsigned {
+  // Take up to kMaxUdpBatch packets off the queue, and build one message per destination and segment size run
+  unsigned nof_pdus = 0;
+  unsigned nof_msgs = 0;
+  unsigned segments = 0;
+  for (auto cell = front(out); cell != nullptr && nof_pdus < kMaxUdpBatch; cell = front(out)) {
+    srsran::unique_byte_buffer_t pdu(cell->pdu);
+    auto mch_idx = cell->mch_idx;
+    auto lcid = cell->lcid;
+    pop(out);
+
+    auto ip_hdr = reinterpret_cast<iphdr*>(pdu->msg);
+    auto ip_hdr_len = ipv4_header_length(*pdu);
+    if (ip_hdr_len == 0 || ip_hdr->protocol != 17 /*UDP*/ || pdu->N_bytes < ip_hdr_len + sizeof(udphdr)) {
+      spdlog::debug("GW: dropping malformed or non-UDP packet in UDP output mode");
+      _rest._gw.drops++;
+      continue;
+    }
+    auto udp_hdr = reinterpret_cast<udphdr*>(pdu->msg + ip_hdr_len);
+    uint32_t udp_len = std::min(static_cast<uint32_t>(ntohs(udp_hdr->len)), pdu->N_bytes - ip_hdr_len);
+    if (udp_len < sizeof(udphdr)) {
+      _rest._gw.drops++;
+      continue;
+    }
+    set_dest(out, mch_idx, lcid, ip_hdr->daddr, ntohs(udp_hdr->dest));
+
+    auto payload = pdu->msg + ip_hdr_len + sizeof(udphdr);
+    auto len = udp_len - static_cast<uint32_t>(sizeof(udphdr));
+    out.udp_iovs[nof_pdus] = {payload, len};
+
+    // With segmentation offload, all segments of a message but the last have the size of the first
+    auto prev = nof_msgs > 0 ? &out.udp_msgs[nof_msgs - 1].msg_hdr : nullptr;
+    if (out.udp_gso && prev != nullptr &&
+        out.udp_addrs[nof_msgs - 1].sin_addr.s_addr == ip_hdr->daddr && out.udp_addrs[nof_msgs - 1].sin_port == udp_hdr->dest &&
+        prev->msg_iov[prev->msg_iovlen - 1].iov_len == prev->msg_iov[0].iov_len && len <= prev->msg_iov[0].iov_len &&
+        len > 0 && (segments + 1) * prev->msg_iov[0].iov_len <= 65000) {
+      prev->msg_iovlen++;
+      segments++;
+    } else {
+      auto& addr = out.udp_addrs[nof_msgs];
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = ip_hdr->daddr;
+      addr.sin_port = udp_hdr->dest;
+      auto& msg = out.udp_msgs[nof_msgs].msg_hdr;
+      msg = {};
+      msg.msg_name = &addr;
+      msg.msg_namelen = sizeof(addr);
+      msg.msg_iov = &out.udp_iovs[nof_pdus];
+      msg.msg_iovlen = 1;
+      nof_msgs++;
+      segments = 1;
+    }
+    out.udp_pdus[nof_pdus++] = std::move(pdu);
+  }
+
+  for (auto m = 0U; m < nof_msgs; m++) {
+    auto& msg = out.udp_msgs[m].msg_hdr;
+    if (msg.msg_iovlen > 1) {
+      msg.msg_control = out.udp_cmsgs[m].data();
+      msg.msg_controllen = out.udp_cmsgs[m].size();
+      auto cmsg = CMSG_FIRSTHDR(&msg);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      auto segment_size = static_cast<uint16_t>(msg.msg_iov[0].iov_len);
+      memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    }
+  }
+
+  unsigned done = 0;
+  while (done < nof_msgs) {
+    auto n = sendmmsg(out.udp_fd, &out.udp_msgs[done], nof_msgs - done, 0);
+    if (n > 0) {
+      done += static_cast<unsigned>(n);
+      continue;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    auto& failed = out.udp_msgs[done].msg_hdr;
+    if (n < 0 && failed.msg_iovlen > 1 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+      // Segmentation offload is not supported here. Split this message, and do without from now on.
+      spdlog::warn("UDP segmentation offload not available ({}), sending packets one by one", strerror(errno));
+      out.udp_gso = false;
+      unsigned first_iov = static_cast<unsigned>(failed.msg_iov - out.udp_iovs.data());
+      for (auto i = 0U; i < failed.msg_iovlen; i++) {
+        auto sent = sendto(out.udp_fd, out.udp_iovs[first_iov + i].iov_base, out.udp_iovs[first_iov + i].iov_len, 0,
+            static_cast<sockaddr*>(failed.msg_name), failed.msg_namelen);
+        if (sent < 0) {
+          _rest._gw.write_errors++;
+        }
+      }
+      done++;
+      continue;
+    }
+    spdlog::warn("GW: UDP send error {}", strerror(errno));
+    _rest._gw.write_errors += out.udp_msgs[done].msg_hdr.msg_iovlen;
+    done++;
+  }
+  _rest._gw.packets += nof_pdus;
+
+  // Return the buffers to the pool
+  for (auto i = 0U; i < nof_pdus; i++) {
+    out.udp_pdus[i].reset();
+  }
+  return nof_pdus;
+}
+
+auto Gw::init_udp(output_t& out) -> bool {
+  out.udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (out.udp_fd < 0) {
+    spdlog::error("Failed to create UDP output socket: {}", strerror(errno));
+    return false;
+  }
+  in_addr interface = {};
+  if (inet_pton(AF_INET, _udp_interface.c_str(), &interface) != 1) {
+    spdlog::error("Invalid UDP output interface address {}", _udp_interface);
+    return false;
+  }
+  if (setsockopt(out.udp_fd, IPPROTO_IP, IP_MULTICAST_IF, &interface, sizeof(interface)) < 0) {
+    spdlog::warn("Failed to set multicast interface {}: {}", _udp_interface, strerror(errno));
+  }
+  if (setsockopt(out.udp_fd, IPPROTO_IP, IP_MULTICAST_TTL, &_udp_ttl, sizeof(_udp_ttl)) < 0) {
+    spdlog::warn("Failed to set multicast TTL: {}", strerror(errno));
+  }
+  int send_buffer = 4 * 1024 * 1024;
+  setsockopt(out.udp_fd, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer));
+  return true;
+}
+
+auto Gw::open_tun(const std::string& dev_name, bool& multi_queue) -> int {
   char* err_str = nullptr;
   struct ifreq ifr = {};
 
-  _tun_fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
-  spdlog::info("TUN file descriptor {}", _tun_fd);
-  if (0 > _tun_fd) {
+  auto tun_fd = open("/dev/net/tun", O_RDWR | O_CLOEXEC);
+  spdlog::info("TUN file descriptor {}", tun_fd);
+  if (0 > tun_fd) {
     err_str = strerror(errno);
     spdlog::error("Failed to open TUN device {}", err_str);
-    _tun_fd = -1;
-  }
-
-  std::string dev_name = "mbms_modem_tun";
-  if (nullptr != std::getenv("MODEM_TUN_INTERFACE")) {
-    dev_name = std::getenv("MODEM_TUN_INTERFACE");
+    return -1;
   }
 
   memset(&ifr, 0, sizeof(ifr));
   ifr.ifr_flags = IFF_UP | IFF_TUN | IFF_NO_PI;
+  if (multi_queue) {
+    // Every open with this flag attaches another queue to the same device
+    ifr.ifr_flags |= IFF_MULTI_QUEUE;
+  }
   strncpy(ifr.ifr_ifrn.ifrn_name, dev_name.c_str(),
           std::min(dev_name.length(), static_cast<size_t>(IFNAMSIZ - 1)));
   ifr.ifr_ifrn.ifrn_name[IFNAMSIZ - 1] = 0;
 
-  if (0 > ioctl(_tun_fd, TUNSETIFF, &ifr)) {
+  auto result = ioctl(tun_fd, TUNSETIFF, &ifr);
+  if (0 > result && multi_queue && errno == EINVAL) {
+    // An existing persistent device that was created without multi queue support can't be attached to with it
+    spdlog::warn("TUN device {} does not support multiple queues, falling back to a single queue", dev_name);
+    multi_queue = false;
+    ifr.ifr_flags &= ~IFF_MULTI_QUEUE;
+    result = ioctl(tun_fd, TUNSETIFF, &ifr);
+  }
+  if (0 > result) {
     err_str = strerror(errno);
     spdlog::error("Failed to set TUN device name {}", err_str);
-    close(_tun_fd);
-    _tun_fd = -1;
+    close(tun_fd);
+    return -1;
   }
+  return tun_fd;
+}
 
-  if (0 > ioctl(_tun_fd, TUNSETPERSIST, 1)) {
-    err_str = strerror(errno);
-    spdlog::warn("Failed to set TUNSETPERSIST\n");
+auto Gw::init() -> bool {
+  if (_udp_output) {
+    for (auto& out : _outputs) {
+      if (!init_udp(*out)) {
+        if (out->udp_fd != -1) {
+          close(out->udp_fd);
+          out->udp_fd = -1;
+        }
+        return false;
+      }
+    }
+    spdlog::info("Sending MTCH payloads to their UDP destinations via {} on {} socket(s){}", _udp_interface,
+        _nof_outputs, _udp_gso ? ", with segmentation offload" : "");
+  } else {
+    std::string dev_name = "mbms_modem_tun";
+    if (nullptr != std::getenv("MODEM_TUN_INTERFACE")) {
+      dev_name = std::getenv("MODEM_TUN_INTERFACE");
+    }
+
+    bool multi_queue = _nof_outputs > 1;
+    _outputs[0]->tun_fd = open_tun(dev_name, multi_queue);
+    if (!multi_queue && _nof_outputs > 1) {
+      _nof_outputs = 1;
+      _outputs.resize(1);
+    }
+    for (auto o = 1U; o < _nof_outputs; o++) {
+      _outputs[o]->tun_fd = open_tun(dev_name, multi_queue);
+    }
+    if (_outputs[0]->tun_fd != -1 && 0 > ioctl(_outputs[0]->tun_fd, TUNSETPERSIST, 1)) {
+      spdlog::warn("Failed to set TUNSETPERSIST\n");
+    }
+    if (_nof_outputs > 1) {
+      spdlog::info("TUN device {} with {} queues, PDUs are assigned to them by MCH", dev_name, _nof_outputs);
+    }
+  }
+
+  _running = true;
+  for (auto& out : _outputs) {
+    out->thread = std::thread{&Gw::output, this, std::ref(*out)};
   }
+  return true;
 }
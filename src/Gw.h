@@ -23,15 +23,43 @@
 #include "srsran/asn1/rrc.h"
 #include "srsran/interfaces/ue_gw_interfaces.h"
 
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <libconfig.h++>
 
 #include "Phy.h"
+#include "RestHandler.h"
 
 /**
  *  Network gateway component.
  *
  *  Creates a TUN network interface, and writes the received MCH PDU contents out on it.
+ *
+ *  PDUs are delivered by whichever thread passed them through RLC and PDCP. They are put on a bounded
+ *  lock-free queue and written out by a dedicated output thread, so a slow TUN consumer does not hold
+ *  up decoding. The output thread writes all queued packets per wakeup, and only sleeps if the queue is empty.
+ *  PDUs are dropped if the queue is full.
+ *
+ *  With more than one output queue, the TUN device is opened in multi queue mode. Every queue has its own
+ *  TUN queue fd and output thread, and the PDUs of an MCH always go to the same queue, so independent MCHs
+ *  are written concurrently while the packets of each MCH stay in order. If the device already exists as a
+ *  persistent single queue device, it can't be attached to in multi queue mode, and only one queue is used.
+ *
+ *  Alternatively, the UDP payloads of the packets are sent directly to their (multicast) destination
+ *  from a UDP socket, bypassing the TUN device and the kernel routing. Packets are sent in batches with
+ *  sendmmsg, and consecutive packets of the same size to the same destination are passed to the kernel
+ *  as one message with UDP segmentation offload.
  */
 class Gw : public srsue::gw_interface_stack {
   public:
@@ -40,10 +68,9 @@ class Gw : public srsue::gw_interface_stack {
      *
      *  @param cfg Config singleton reference
      *  @param phy PHY reference
+     *  @param rest RESTful API handler the output counters are reported to
      */
-    Gw(const libconfig::Config& /*cfg*/, Phy& phy)
-        : _phy(phy)
-      {}
+    Gw(const libconfig::Config& cfg, Phy& phy, RestHandler& rest);
 
     /**
      *  Default destructor.
@@ -51,13 +78,16 @@ class Gw : public srsue::gw_interface_stack {
     virtual ~Gw();
 
     /**
-     *  Creates the TUN interface according to params from Cfg
+     *  Creates the TUN interface queues or UDP sockets according to params from Cfg, and starts the output threads
+     *
+     *  Returns false if the UDP output sockets could not be set up. A TUN device that can not be opened
+     *  is not fatal, its packets are dropped.
      */
-    void init();
+    bool init();
 
     /**
-     *  Handle a MCH PDU. Verifies the contents start with an IP header, checks the IP header checksum
-     *  and corrects it if necessary, and writes the packet out to the TUN interface. 
+     *  Handle a MCH PDU. Queues it for the output thread, which verifies the contents start with an IP header,
+     *  checks the IP header checksum and corrects it if necessary, and writes the packet out to the TUN interface.
      */
     void write_pdu_mch(uint32_t mch_idx, uint32_t lcid, srsran::unique_byte_buffer_t pdu) override;
 
@@ -71,7 +101,66 @@ class Gw : public srsue::gw_interface_stack {
     int deactivate_eps_bearer(const uint32_t /*eps_bearer_id*/) override {return 0;};
     bool is_running() override { return true; };
   private:
-    std::mutex _wr_mutex;
-    int32_t _tun_fd = -1;
+    typedef struct {
+      std::atomic<size_t> seq;
+      srsran::byte_buffer_t* pdu;
+      uint32_t mch_idx;
+      uint32_t lcid;
+    } cell_t;
+
+    /**
+     *  Max nr of packets per sendmmsg call, and of segments per UDP segmentation offload message
+     */
+    static const unsigned kMaxUdpBatch = 64;
+
+    /**
+     *  One output queue: the PDU queue, its output thread, and the TUN queue or UDP socket it writes to.
+     */
+    struct output_t {
+      std::unique_ptr<cell_t[]> queue;  // NOLINT
+      size_t queue_mask = 0;
+      std::atomic<size_t> enqueue_pos = {0};
+      std::atomic<size_t> dequeue_pos = {0};  /**< Only written by the output thread */
+
+      std::thread thread;
+      std::atomic<bool> sleeping = {false};
+      std::mutex wakeup_mutex;
+      std::condition_variable wakeup;
+
+      int32_t tun_fd = -1;
+      int udp_fd = -1;
+      bool udp_gso = true;
+      std::array<srsran::unique_byte_buffer_t, kMaxUdpBatch> udp_pdus;
+      std::array<iovec, kMaxUdpBatch> udp_iovs = {};
+      std::array<mmsghdr, kMaxUdpBatch> udp_msgs = {};
+      std::array<sockaddr_in, kMaxUdpBatch> udp_addrs = {};
+      std::array<std::array<char, CMSG_SPACE(sizeof(uint16_t))>, kMaxUdpBatch> udp_cmsgs = {};
+
+      std::map<std::pair<uint32_t, uint32_t>, std::pair<uint32_t, uint16_t>> dests;  /**< Last destination per MCH and LCID */
+    };
+
+    static bool push(output_t& out, srsran::unique_byte_buffer_t& pdu, uint32_t mch_idx, uint32_t lcid);
+    static cell_t* front(output_t& out);
+    static void pop(output_t& out);
+    static uint32_t ipv4_header_length(const srsran::byte_buffer_t& pdu);
+
+    void output(output_t& out);
+    void write_out(output_t& out, srsran::byte_buffer_t* pdu, uint32_t mch_idx, uint32_t lcid);
+    unsigned send_udp(output_t& out);
+    bool init_udp(output_t& out);
+    int open_tun(const std::string& dev_name, bool& multi_queue);
+    void set_dest(output_t& out, uint32_t mch_idx, uint32_t lcid, uint32_t addr, uint16_t port);
+
     Phy& _phy;
+    RestHandler& _rest;
+
+    unsigned _queue_size = 4096;
+    unsigned _nof_outputs = 1;
+    bool _udp_output = false;
+    bool _udp_gso = true;
+    std::string _udp_interface = "0.0.0.0";
+    int _udp_ttl = 1;
+
+    std::vector<std::unique_ptr<output_t>> _outputs;
+    std::atomic<bool> _running = {false};
 };
@@ -0,0 +1,113 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "GwBenchmark.h"
+
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+static const uint32_t kPayloadSize = 1200;
+static const uint32_t kPacketSize = sizeof(iphdr) + sizeof(udphdr) + kPayloadSize;
+
+static auto ip_checksum(const uint8_t* header, uint32_t len) -> uint16_t {
+  uint32_t sum = 0;
+  for (auto i = 0U; i + 1 < len; i += 2) {
+    sum += static_cast<uint32_t>(header[i] << 8U | header[i + 1]);
+  }
+  while (sum >> 16U) {
+    sum = (sum & 0xFFFFU) + (sum >> 16U);
+  }
+  return htons(static_cast<uint16_t>(~sum));
+}
+
+auto GwBenchmark::run() -> bool {
+  spdlog::info("Gateway output benchmark, {} MTCH(s), {} byte packets for {} s", _nof_mtchs, kPacketSize, _seconds);
+  uint64_t packets = _rest._gw.packets;
+  uint64_t drops = _rest._gw.drops;
+  uint64_t write_errors = _rest._gw.write_errors;
+
+  std::atomic<bool> stop = {false};
+  std::vector<std::atomic<uint64_t>> offered(_nof_mtchs);
+  std::vector<std::thread> producers;
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0U; i < _nof_mtchs; i++) {
+    producers.emplace_back(&GwBenchmark::produce, this, i, std::cref(stop), std::ref(offered[i]));
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(_seconds));
+  stop = true;
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  // Let the output threads empty their queues
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  packets = _rest._gw.packets - packets;
+  drops = _rest._gw.drops - drops;
+  write_errors = _rest._gw.write_errors - write_errors;
+  uint64_t total_offered = 0;
+  for (auto i = 0U; i < _nof_mtchs; i++) {
+    spdlog::info("MTCH {}: {:.0f} packets/s offered", i, static_cast<double>(offered[i]) / elapsed);
+    total_offered += offered[i];
+  }
+  spdlog::info("Written {:.0f} packets/s, {:.1f} Mbit/s. Offered {} packets, {} dropped at the output queues, {} write errors",
+      static_cast<double>(packets) / elapsed, static_cast<double>(packets) * kPacketSize * 8 / elapsed / 1e6,
+      total_offered, drops, write_errors);
+  return packets > 0;
+}
+
+void GwBenchmark::produce(uint32_t mch_idx, const std::atomic<bool>& stop, std::atomic<uint64_t>& offered) {
+  // One multicast group per MTCH
+  uint8_t packet[kPacketSize] = {};
+  auto ip_hdr = reinterpret_cast<iphdr*>(packet);
+  ip_hdr->version = 4;
+  ip_hdr->ihl = 5;
+  ip_hdr->tot_len = htons(kPacketSize);
+  ip_hdr->ttl = 1;
+  ip_hdr->protocol = IPPROTO_UDP;
+  ip_hdr->saddr = htonl(0x0A000001);  // 10.0.0.1
+  ip_hdr->daddr = htonl(0xEF0B0400 + mch_idx);  // 239.11.4.x
+  ip_hdr->check = ip_checksum(packet, sizeof(iphdr));
+  auto udp_hdr = reinterpret_cast<udphdr*>(packet + sizeof(iphdr));
+  udp_hdr->source = htons(5000);
+  udp_hdr->dest = htons(static_cast<uint16_t>(5000 + mch_idx));
+  udp_hdr->len = htons(sizeof(udphdr) + kPayloadSize);
+
+  while (!stop.load(std::memory_order_relaxed)) {
+    auto pdu = srsran::make_byte_buffer();
+    if (pdu == nullptr) {
+      // Buffer pool exhausted, the output threads are behind
+      std::this_thread::yield();
+      continue;
+    }
+    memcpy(pdu->msg, packet, kPacketSize);
+    pdu->N_bytes = kPacketSize;
+    _gw.write_pdu_mch(mch_idx, 1, std::move(pdu));
+    offered.fetch_add(1, std::memory_order_relaxed);
+  }
+}
@@ -0,0 +1,62 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "Gw.h"
+#include "RestHandler.h"
+
+/**
+ *  Throughput benchmark of the network gateway output.
+ *
+ *  Starts one producer thread per MTCH, each passing synthetic IPv4/UDP multicast packets to the gateway
+ *  as fast as it accepts them, the way PDCP delivers the PDUs of concurrent MCHs. Logs the packet and bit rate
+ *  written out, and the packets dropped at the output queues. Run with the --gw-benchmark command line option.
+ */
+class GwBenchmark {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param gw Initialized gateway to write to
+     *  @param rest RESTful API handler holding the gateway counters
+     *  @param nof_mtchs Nr of concurrent MTCHs, each on its own MCH
+     *  @param seconds Duration of the measurement
+     */
+    GwBenchmark(Gw& gw, RestHandler& rest, unsigned nof_mtchs, unsigned seconds)
+      : _gw(gw)
+      , _rest(rest)
+      , _nof_mtchs(nof_mtchs)
+      , _seconds(seconds) {}
+
+    /**
+     *  Run the benchmark and log the results. Returns false if no packet could be written.
+     */
+    bool run();
+
+  private:
+    void produce(uint32_t mch_idx, const std::atomic<bool>& stop, std::atomic<uint64_t>& offered);
+
+    Gw& _gw;
+    RestHandler& _rest;
+    unsigned _nof_mtchs;
+    unsigned _seconds;
+};
@@ -0,0 +1,165 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "HugePageArena.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <sys/mman.h>
+
+#include "spdlog/spdlog.h"
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+
+HugePageArena::HugePageArena(const libconfig::Config& cfg) {
+  cfg.lookupValue("modem.phy.huge_pages.enabled", _enabled);
+  cfg.lookupValue("modem.phy.huge_pages.arena_size_mb", _size_mb);
+  cfg.lookupValue("modem.phy.huge_pages.page_size_mb", _page_size_mb);
+  if (_page_size_mb != 2 && _page_size_mb != 1024) {
+    spdlog::warn("Unsupported huge page size {} MB, using 2 MB", _page_size_mb);
+    _page_size_mb = 2;
+  }
+}
+
+HugePageArena::~HugePageArena() {
+  if (_mapping != nullptr) {
+    munmap(_mapping, _mapped_size);
+  }
+}
+
+auto HugePageArena::init() -> bool {
+  if (!_enabled || _size_mb == 0) {
+    spdlog::info("Huge page arena disabled, PHY buffers are allocated from the heap");
+    return true;
+  }
+
+  size_t page_size = static_cast<size_t>(_page_size_mb) << 20U;
+  _size = ((static_cast<size_t>(_size_mb) << 20U) + page_size - 1) / page_size * page_size;
+
+  // Explicit huge pages from the hugetlbfs pool (vm.nr_hugepages)
+  int page_flag = (_page_size_mb == 1024 ? 30 : 21) << MAP_HUGE_SHIFT;
+  void* mem = mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | page_flag, -1, 0);
+  if (mem != MAP_FAILED) {
+    _mapping = mem;
+    _mapped_size = _size;
+    _base = static_cast<uint8_t*>(mem);
+    spdlog::info("PHY memory arena: {} MB using {} MB huge pages", _size >> 20U, _page_size_mb);
+  } else {
+    spdlog::warn("Could not map {} MB of {} MB huge pages ({}), falling back to transparent huge pages",
+        _size_mb, _page_size_mb, strerror(errno));
+
+    // Over-allocate by one page to be able to align the arena to a huge page boundary
+    _mapped_size = _size + page_size;
+    mem = mmap(nullptr, _mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      spdlog::error("Could not map {} MB for the PHY memory arena: {}", _size_mb, strerror(errno));
+      return false;
+    }
+    _mapping = mem;
+    auto addr = reinterpret_cast<uintptr_t>(mem);  // NOLINT
+    auto aligned = (addr + page_size - 1) / page_size * page_size;
+    _base = static_cast<uint8_t*>(mem) + (aligned - addr);
+    if (madvise(_base, _size, MADV_HUGEPAGE) != 0) {
+      spdlog::warn("Transparent huge pages not available for the PHY memory arena: {}", strerror(errno));
+    }
+    spdlog::info("PHY memory arena: {} MB using transparent huge pages", _size >> 20U);
+  }
+
+  _free[0] = _size;
+  return true;
+}
+
+auto HugePageArena::allocate(size_t bytes) -> void* {
+  size_t len = (bytes + kAlignment - 1) / kAlignment * kAlignment;
+  if (len == 0) {
+    return nullptr;
+  }
+
+  if (_base != nullptr) {
+    const std::lock_guard<std::mutex> lock(_mutex);
+    // First fit. There are only a few dozen blocks, all allocated when a cell is configured.
+    for (auto it = _free.begin(); it != _free.end(); ++it) {
+      if (it->second < len) {
+        continue;
+      }
+      size_t offset = it->first;
+      size_t remaining = it->second - len;
+      _free.erase(it);
+      if (remaining > 0) {
+        _free[offset + len] = remaining;
+      }
+      _allocated[offset] = len;
+      _used += len;
+      if (_used > _peak) {
+        _peak = _used;
+        spdlog::debug("PHY memory arena: {:.1f} of {} MB in use", static_cast<double>(_peak) / (1U << 20U), _size >> 20U);
+      }
+      return _base + offset;
+    }
+    spdlog::warn("PHY memory arena exhausted, allocating {} bytes from the heap", bytes);
+  }
+
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, kAlignment, len) != 0) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+void HugePageArena::release(void* ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  auto p = static_cast<uint8_t*>(ptr);
+  if (_base == nullptr || p < _base || p >= _base + _size) {
+    free(ptr);  // NOLINT
+    return;
+  }
+
+  const std::lock_guard<std::mutex> lock(_mutex);
+  auto offset = static_cast<size_t>(p - _base);
+  auto allocated = _allocated.find(offset);
+  if (allocated == _allocated.end()) {
+    spdlog::error("Releasing unknown block at offset {} of the PHY memory arena", offset);
+    return;
+  }
+  size_t len = allocated->second;
+  _allocated.erase(allocated);
+  _used -= len;
+
+  // Merge with the neighbouring free blocks
+  auto next = _free.lower_bound(offset);
+  if (next != _free.end() && offset + len == next->first) {
+    len += next->second;
+    next = _free.erase(next);
+  }
+  if (next != _free.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == offset) {
+      prev->second += len;
+      return;
+    }
+  }
+  _free[offset] = len;
+}
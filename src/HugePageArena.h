@@ -0,0 +1,107 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <libconfig.h++>
+#include "srsran/srsran.h"
+
+/**
+ *  Memory arena for the large PHY working buffers, backed by huge pages.
+ *
+ *  At low subcarrier spacings the sample, FFT and channel estimation buffers are many MB in size. With
+ *  4 KB pages they span thousands of TLB entries. The arena reserves one region of 2 MB (or 1 GB)
+ *  huge pages at startup and hands out SIMD-aligned blocks from it.
+ *
+ *  If no hugetlbfs pages are available, the region is mapped with regular pages and marked for
+ *  transparent huge pages instead. Allocations that do not fit into the arena, or all allocations if
+ *  it is disabled, fall back to the regular heap. release() handles both.
+ *
+ *  Allocation and release are thread safe, but not meant for the per-subframe path: they only happen
+ *  when buffers are (re)sized.
+ */
+class HugePageArena {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     */
+    explicit HugePageArena(const libconfig::Config& cfg);
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~HugePageArena();
+
+    /**
+     *  Reserve the arena memory. Must be called once before the first call to allocate().
+     *
+     *  Returns false only if the arena is enabled and no memory could be mapped at all.
+     */
+    bool init();
+
+    /**
+     *  Allocate a SIMD-aligned block of memory.
+     *
+     *  @param bytes Size of the block
+     *  @return Pointer to the block, nullptr if out of memory
+     */
+    void* allocate(size_t bytes);
+
+    /**
+     *  Allocate a SIMD-aligned buffer for nof_samples complex samples.
+     */
+    cf_t* allocate_cf(uint32_t nof_samples) { return static_cast<cf_t*>(allocate(nof_samples * sizeof(cf_t))); }
+
+    /**
+     *  Return a block obtained from allocate() or allocate_cf(). nullptr is ignored.
+     */
+    void release(void* ptr);
+
+    /**
+     *  Bytes currently allocated from the arena
+     */
+    size_t used() {
+      const std::lock_guard<std::mutex> lock(_mutex);
+      return _used;
+    }
+
+  private:
+    static const size_t kAlignment = 64;
+
+    bool _enabled = true;
+    unsigned _size_mb = 64;
+    unsigned _page_size_mb = 2;
+
+    void* _mapping = nullptr;
+    size_t _mapped_size = 0;
+    uint8_t* _base = nullptr;  /**< Start of the arena, aligned to the huge page size */
+    size_t _size = 0;
+
+    std::mutex _mutex;
+    std::map<size_t, size_t> _free;       /**< offset -> length of free blocks */
+    std::map<size_t, size_t> _allocated;  /**< offset -> length of allocated blocks */
+    size_t _used = 0;
+    size_t _peak = 0;
+};
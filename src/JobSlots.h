@@ -0,0 +1,83 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/**
+ *  Preallocated state for jobs that are shared between a caller and pool helpers.
+ *
+ *  A caller that splits work across the PHY thread pool shares the job state with its helpers, and
+ *  helpers may only get to run after the caller has returned. Instead of allocating the state per
+ *  call and sharing ownership, jobs are taken from a fixed set of slots and reference counted: the
+ *  caller acquires a slot, retains it once per helper it starts, and the slot is free again once
+ *  the caller and all helpers have released it.
+ *
+ *  T must have a std::atomic<unsigned> member named refs. Callers reinitialize all other members
+ *  after acquire().
+ */
+template <class T>
+class JobSlots {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param size Nr of slots. Should exceed the nr of jobs running at once, plus the helpers that
+     *              may still be queued for finished ones.
+     */
+    explicit JobSlots(size_t size)
+      : _slots(new T[size])  // NOLINT
+      , _size(size) {}
+
+    /**
+     *  Take a free slot, holding one reference. Returns nullptr if all slots are in use, in which
+     *  case the caller should do the work alone.
+     */
+    T* acquire() {
+      // Start at a different slot each time, so concurrent callers don't all contend for the first ones
+      auto start = _next.fetch_add(1, std::memory_order_relaxed);
+      for (auto i = 0U; i < _size; i++) {
+        auto& slot = _slots[(start + i) % _size];
+        unsigned free = 0;
+        if (slot.refs.load(std::memory_order_relaxed) == 0 &&
+            slot.refs.compare_exchange_strong(free, 1, std::memory_order_acquire)) {
+          return &slot;
+        }
+      }
+      return nullptr;
+    }
+
+    /**
+     *  Add a reference, for a helper that is about to be started.
+     */
+    static void retain(T* job) { job->refs.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     *  Drop a reference. The slot can be reused once the last one is gone.
+     */
+    static void release(T* job) { job->refs.fetch_sub(1, std::memory_order_release); }
+
+  private:
+    std::unique_ptr<T[]> _slots;  // NOLINT
+    size_t _size;
+    std::atomic<size_t> _next = {0};
+};
@@ -0,0 +1,75 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "LatencyStats.h"
+
+#include <algorithm>
+
+void LatencyStats::add(unsigned key, uint32_t us) {
+  if (key >= kMaxKeys) {
+    return;
+  }
+  auto& h = _histograms[key];
+  auto bucket = std::min(us / _bucket_width_us, kBuckets - 1);
+  h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+
+  auto max = h.max_us.load(std::memory_order_relaxed);
+  while (us > max && !h.max_us.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+}
+
+auto LatencyStats::summary(bool reset) -> std::vector<summary_t> {
+  std::vector<summary_t> result;
+  for (auto key = 0U; key < kMaxKeys; key++) {
+    auto& h = _histograms[key];
+    uint64_t count = h.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      continue;
+    }
+
+    summary_t s = {};
+    s.key = key;
+    s.count = count;
+    s.max_us = h.max_us.load(std::memory_order_relaxed);
+
+    uint64_t seen = 0;
+    bool p50_found = false;
+    for (auto b = 0U; b < kBuckets; b++) {
+      seen += h.buckets[b].load(std::memory_order_relaxed);
+      if (!p50_found && seen * 2 >= count) {
+        s.p50_us = (b + 1) * _bucket_width_us;
+        p50_found = true;
+      }
+      if (seen * 100 >= count * 99) {
+        s.p99_us = (b + 1) * _bucket_width_us;
+        break;
+      }
+    }
+    result.push_back(s);
+
+    if (reset) {
+      for (auto& b : h.buckets) {
+        b.store(0, std::memory_order_relaxed);
+      }
+      h.count.store(0, std::memory_order_relaxed);
+      h.max_us.store(0, std::memory_order_relaxed);
+    }
+  }
+  return result;
+}
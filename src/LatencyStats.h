@@ -0,0 +1,89 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ *  Lock-free latency histogram, keyed by a small integer (e.g. the MCS).
+ *
+ *  Samples are recorded from any thread with add(). summary() computes count,
+ *  median, 99th percentile and maximum per key, and optionally resets the counters.
+ */
+class LatencyStats {
+ public:
+    /**
+     *  Highest key + 1 (MCS values are 0..31)
+     */
+    static const unsigned kMaxKeys = 32;
+
+    /**
+     *  Default histogram bucket width in microseconds
+     */
+    static const uint32_t kBucketWidthUs = 25;
+
+    /**
+     *  Number of histogram buckets. Samples above the last bucket are counted in it.
+     */
+    static const unsigned kBuckets = 400;
+
+    /**
+     *  Default constructor.
+     *
+     *  @param bucket_width_us Histogram bucket width. Latencies up to kBuckets times this are resolved.
+     */
+    explicit LatencyStats(uint32_t bucket_width_us = kBucketWidthUs)
+      : _bucket_width_us(bucket_width_us) {}
+
+    typedef struct {
+      unsigned key;
+      uint64_t count;
+      uint32_t p50_us;
+      uint32_t p99_us;
+      uint32_t max_us;
+    } summary_t;
+
+    /**
+     *  Record a latency sample.
+     *
+     *  @param key Key to record for. Values >= kMaxKeys are ignored.
+     *  @param us  Latency in microseconds
+     */
+    void add(unsigned key, uint32_t us);
+
+    /**
+     *  Get a summary for all keys that have samples.
+     *
+     *  @param reset Clear all counters after reading
+     */
+    std::vector<summary_t> summary(bool reset);
+
+ private:
+    struct histogram_t {
+      std::array<std::atomic<uint32_t>, kBuckets> buckets = {};
+      std::atomic<uint64_t> count = {0};
+      std::atomic<uint32_t> max_us = {0};
+    };
+    uint32_t _bucket_width_us;
+    std::array<histogram_t, kMaxKeys> _histograms = {};
+};
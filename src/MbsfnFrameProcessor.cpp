@@ -18,31 +18,19 @@
 //
 
 #include "MbsfnFrameProcessor.h"
-#include "spdlog/spdlog.h"
-
-std::map<uint8_t, uint16_t> MbsfnFrameProcessor::_sched_stops;
 
-std::mutex MbsfnFrameProcessor::_sched_stop_mutex;
-std::mutex MbsfnFrameProcessor::_rlc_mutex;
-
-auto MbsfnFrameProcessor::init() -> bool {
-  _signal_buffer_max_samples = 3 * SRSRAN_SF_LEN_PRB(MAX_PRB);
+#include <chrono>
 
-  for (auto ch = 0U; ch < _rx_channels; ch++) {
-    _signal_buffer_rx[ch] = srsran_vec_cf_malloc(_signal_buffer_max_samples);
-    if (!_signal_buffer_rx[ch]) {
-      spdlog::error("Could not allocate regular DL signal buffer\n");
-      return false;
-    }
-  }
+#include "AllocationTracker.h"
+#include "ParallelFft.h"
+#include "spdlog/spdlog.h"
 
-  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, MAX_PRB, _rx_channels) != 0) {
-    spdlog::error("Could not init ue_dl\n");
-    return false;;
-  }
+std::array<MbsfnFrameProcessor::sched_stops_t, MchReorderBuffer::kMaxMchs> MbsfnFrameProcessor::_sched_stops;
 
-  srsran_softbuffer_rx_init(&_softbuffer, 100);
 
+auto MbsfnFrameProcessor::init() -> bool {
+  // Signal buffers, ue_dl and softbuffer are allocated in configure_mbsfn(), once
+  // the bandwidth and subcarrier spacing of the cell are known.
   _ue_dl_cfg.snr_to_cqi_offset = 0;
 
   srsran_chest_dl_cfg_t* chest_cfg = &_ue_dl_cfg.chest_cfg;
@@ -67,35 +55,198 @@ auto MbsfnFrameProcessor::init() -> bool {
   _pmch_cfg.pdsch_cfg.decoder_type       = SRSRAN_MIMO_DECODER_MMSE;
 
   _sf_cfg.sf_type = SRSRAN_SF_MBSFN;
+
+  _batch_buffers.resize(_batch_size);
+  _batch_ttis.resize(_batch_size);
+  _batch_received.resize(_batch_size);
+  _batch_samples.resize(_batch_size);
+  _batch_tickets.resize(_batch_size);
   return true;
 }
 
 MbsfnFrameProcessor::~MbsfnFrameProcessor() {
-  srsran_softbuffer_rx_free(&_softbuffer);
-  srsran_ue_dl_free(&_ue_dl);
+  free_buffers();
+}
+
+void MbsfnFrameProcessor::free_buffers() {
+  // resize() may have failed part way, so each buffer and srsran object is checked separately
+  for (auto& slot : _batch_buffers) {
+    for (auto ch = 0U; ch < _rx_channels; ch++) {
+      if (slot[ch]) {
+        _arena.release(slot[ch]);
+        slot[ch] = nullptr;
+      }
+    }
+  }
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    _signal_buffer_rx[ch] = nullptr;
+  }
+  if (_has_softbuffer) {
+    srsran_softbuffer_rx_free(&_softbuffer);
+    _has_softbuffer = false;
+  }
+  if (_has_ue_dl) {
+    srsran_ue_dl_free(&_ue_dl);
+    _ue_dl = {};
+    _has_ue_dl = false;
+  }
+  if (_has_ue_dl_single) {
+    srsran_ue_dl_free(&_ue_dl_single);
+    _ue_dl_single = {};
+    _has_ue_dl_single = false;
+  }
+  _active_ue_dl = &_ue_dl;
+  _allocated_prb = 0;
+  _signal_buffer_max_samples = 0;
+}
+
+auto MbsfnFrameProcessor::resize(uint32_t nof_prb, uint32_t samples) -> bool {
+  if (nof_prb == _allocated_prb && samples == _signal_buffer_max_samples) {
+    return true;
+  }
+
+  free_buffers();
+
+  // The first batch slot is the ue_dl input buffer
+  for (auto& slot : _batch_buffers) {
+    for (auto ch = 0U; ch < _rx_channels; ch++) {
+      slot[ch] = _arena.allocate_cf(samples);
+      if (!slot[ch]) {
+        spdlog::error("Could not allocate regular DL signal buffer\n");
+        return false;
+      }
+    }
+  }
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    _signal_buffer_rx[ch] = _batch_buffers[0][ch];
+  }
+  _signal_buffer_max_samples = samples;
+
+  if (srsran_ue_dl_init(&_ue_dl, _signal_buffer_rx, nof_prb, _rx_channels) != 0) {
+    spdlog::error("Could not init ue_dl\n");
+    return false;
+  }
+  _has_ue_dl = true;
+
+  // Single antenna decoding always reads the first channel's buffer, the selected antenna's samples are moved there
+  if (_antenna_selector.enabled()) {
+    if (srsran_ue_dl_init(&_ue_dl_single, _signal_buffer_rx, nof_prb, 1) != 0) {
+      spdlog::error("Could not init single antenna ue_dl\n");
+      return false;
+    }
+    _has_ue_dl_single = true;
+  }
+
+  if (srsran_softbuffer_rx_init(&_softbuffer, nof_prb) != SRSRAN_SUCCESS) {
+    spdlog::error("Could not init softbuffer\n");
+    return false;
+  }
+  _has_softbuffer = true;
+  _allocated_prb = nof_prb;
+
+  spdlog::info("MBSFN processor sized for {} PRB: {:.1f} kB sample buffers, {:.1f} kB softbuffer, {:.1f} kB payload buffer",
+      nof_prb,
+      static_cast<double>(_batch_size * _rx_channels * samples * sizeof(cf_t)) / 1024.0,
+      static_cast<double>(softbuffer_size(_softbuffer)) / 1024.0,
+      static_cast<double>(_payload_buffer.size()) / 1024.0);
+  return true;
+}
+
+auto MbsfnFrameProcessor::softbuffer_size(const srsran_softbuffer_rx_t& softbuffer) -> size_t {
+  return softbuffer.max_cb * (softbuffer.max_cb_size * sizeof(int16_t) + softbuffer.max_cb_size / 8 + sizeof(bool));
+}
+
+auto MbsfnFrameProcessor::prepare_tb_buffers(uint32_t tbs) -> bool {
+  // The PMCH TBS depends on MCS and subcarrier spacing, so the payload buffer grows on demand
+  // (with a little headroom for srsran's byte-wise unpacking).
+  size_t payload_bytes = tbs / 8 + 32;
+  if (_payload_buffer.size() < payload_bytes) {
+    spdlog::info("Growing MBSFN payload buffer to {} bytes", payload_bytes);
+    _payload_buffer.resize(payload_bytes);
+    _output.reserve(static_cast<uint32_t>(payload_bytes));
+  }
+
+  srsran_cbsegm_t cb_segm = {};
+  if (srsran_cbsegm(&cb_segm, tbs) != SRSRAN_SUCCESS) {
+    return false;
+  }
+  if (cb_segm.C > _softbuffer.max_cb) {
+    // Sized for the cell's PRB, but more code blocks are needed. Fall back to the maximum size.
+    spdlog::info("Growing MBSFN softbuffer from {} to {} code blocks", _softbuffer.max_cb, cb_segm.C);
+    srsran_softbuffer_rx_free(&_softbuffer);
+    _has_softbuffer = false;
+    if (srsran_softbuffer_rx_init(&_softbuffer, MAX_PRB) != SRSRAN_SUCCESS) {
+      spdlog::error("Could not init softbuffer\n");
+      return false;
+    }
+    _has_softbuffer = true;
+  }
+  return cb_segm.C <= _softbuffer.max_cb;
+}
+
+auto MbsfnFrameProcessor::process() -> int {
+  int decoded = 0;
+  if (_batch_len > 0) {
+    // The dispatcher only batches subframes with identical MBSFN configuration, so the
+    // area, PMCH and grant setup is done once for the whole batch.
+    unsigned mch_idx = 0;
+    srsran_mbsfn_cfg_t mbsfn_cfg = _phy.mbsfn_config_for_tti(_batch_ttis[0], mch_idx);
+
+    _pmch_cfg.area_id = _area_id;
+    _ue_dl_cfg.chest_cfg.mbsfn_area_id = _area_id;
+    set_rs_area_id(mbsfn_cfg.mbsfn_area_id);
+
+    if (!_cell.mbms_dedicated) {
+      srsran_ue_dl_set_non_mbsfn_region(&_ue_dl, mbsfn_cfg.non_mbsfn_region_length);
+      if (_has_ue_dl_single) {
+        srsran_ue_dl_set_non_mbsfn_region(&_ue_dl_single, mbsfn_cfg.non_mbsfn_region_length);
+      }
+    }
+
+    if (mbsfn_cfg.enable) {
+      _sf_cfg.tti = _batch_ttis[0];
+      srsran_configure_pmch(&_pmch_cfg, &_cell, &mbsfn_cfg);
+      srsran_ra_dl_compute_nof_re(&_cell, &_sf_cfg, &_pmch_cfg.pdsch_cfg.grant);
+      _pmch_cfg.area_id = _area_id;
+    }
+
+    for (auto i = 0U; i < _batch_len; i++) {
+      if (i > 0) {
+        // srsran runs the FFT on the buffers passed to ue_dl at init, so later subframes
+        // of the batch are moved there before processing. Only what was received is moved.
+        for (auto ch = 0U; ch < _rx_channels; ch++) {
+          srsran_vec_cf_copy(_signal_buffer_rx[ch], _batch_buffers[i][ch], _batch_samples[i]);
+        }
+      }
+      _output.clear();
+      if (process_subframe(_batch_ttis[i], _batch_received[i], mbsfn_cfg, mch_idx) >= 0) {
+        decoded++;
+      }
+      // Every subframe is completed, even if it has not been decoded, so later ones are not held up
+      _reorder.complete(_batch_tickets[i], _output);
+    }
+  }
+  _batch_len = 0;
+  return decoded;
 }
 
-void MbsfnFrameProcessor::set_cell(srsran_cell_t cell) {
-  _cell = cell;
-  srsran_ue_dl_set_cell(&_ue_dl, cell);
+void MbsfnFrameProcessor::discard_batch() {
+  _output.clear();
+  for (auto i = 0U; i < _batch_len; i++) {
+    _reorder.complete(_batch_tickets[i], _output);
+  }
+  _batch_len = 0;
 }
 
-auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
+auto MbsfnFrameProcessor::process_subframe(uint32_t tti, std::chrono::steady_clock::time_point received, const srsran_mbsfn_cfg_t& mbsfn_cfg, unsigned mch_idx) -> int {
+  AllocationTracker::Scope allocations(AllocationTracker::Stage::mbsfn_subframe);
   spdlog::trace("Processing MBSFN TTI {}", tti);
+  auto entered = std::chrono::steady_clock::now();
 
   uint32_t sfn = tti / 10;
   uint8_t sf = tti % 10;
 
-  unsigned mch_idx = 0;
   _sf_cfg.tti = tti;
-  _pmch_cfg.area_id = _area_id;
-  srsran_mbsfn_cfg_t mbsfn_cfg = _phy.mbsfn_config_for_tti(tti, mch_idx);
-  _ue_dl_cfg.chest_cfg.mbsfn_area_id = _area_id;
-  srsran_ue_dl_set_mbsfn_area_id(&_ue_dl, mbsfn_cfg.mbsfn_area_id);
-
-  if (!_cell.mbms_dedicated) {
-    srsran_ue_dl_set_non_mbsfn_region(&_ue_dl, mbsfn_cfg.non_mbsfn_region_length);
-  }
 
   if (sfn%50 == 0) {
     if (mbsfn_cfg.is_mcch) {
@@ -109,7 +260,6 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
 
   if (!mbsfn_cfg.enable) {
     spdlog::trace("PMCH: tti {}: neither MCCH nor MCH enabled. Skipping subframe");
-    _mutex.unlock();
     return -1;
   }
 
@@ -119,39 +269,74 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
     _rest._mch[mch_idx].total++;
   }
 
-  if (srsran_ue_dl_decode_fft_estimate(&_ue_dl, &_sf_cfg, &_ue_dl_cfg) < 0) {
+  // Decode from the best antenna only while reception on it is good enough
+  auto antenna = _antenna_selector.selected();
+  unsigned nof_antennas = _rx_channels;
+  _active_ue_dl = &_ue_dl;
+  if (!_has_ue_dl_single) {
+    antenna = AntennaSelector::kAllAntennas;
+  }
+  if (antenna != AntennaSelector::kAllAntennas) {
+    if (antenna != 0) {
+      srsran_vec_cf_copy(_signal_buffer_rx[0], _signal_buffer_rx[antenna], _signal_buffer_max_samples);
+    }
+    _active_ue_dl = &_ue_dl_single;
+    nof_antennas = 1;
+  }
+
+  ParallelFft::helpers_used(true);
+  auto fft_started = std::chrono::steady_clock::now();
+  auto fft_ret = srsran_ue_dl_decode_fft_estimate(_active_ue_dl, &_sf_cfg, &_ue_dl_cfg);
+  if (fft_ret >= 0 && _ce_store.enabled()) {
+    _ce_store.blend(_cell_context, antenna, tti, _active_ue_dl->chest_res.ce[0], nof_antennas);
+  }
+  _rest._mbsfn_fft_latency.add(ParallelFft::helpers_used(true),
+      static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - fft_started).count()));
+  if (fft_ret < 0) {
     if (mbsfn_cfg.is_mcch) {
       _rest._mcch.errors++;
     } else {
       _rest._mch[mch_idx].errors++;
     }
     spdlog::error("Getting PDCCH FFT estimate");
-    _mutex.unlock();
     return -1;
   }
 
-  srsran_configure_pmch(&_pmch_cfg, &_cell, &mbsfn_cfg);
-  srsran_ra_dl_compute_nof_re(&_cell, &_sf_cfg, &_pmch_cfg.pdsch_cfg.grant);
-
-  _pmch_cfg.area_id = _area_id;
+  if (!prepare_tb_buffers(static_cast<uint32_t>(_pmch_cfg.pdsch_cfg.grant.tb[0].tbs))) {
+    if (mbsfn_cfg.is_mcch) {
+      _rest._mcch.errors++;
+    } else {
+      _rest._mch[mch_idx].errors++;
+    }
+    spdlog::error("Could not prepare buffers for PMCH TB of {} bits", _pmch_cfg.pdsch_cfg.grant.tb[0].tbs);
+    return -1;
+  }
 
   srsran_softbuffer_rx_reset_cb(&_softbuffer, 1);
 
   srsran_pdsch_res_t pmch_dec = {};
   _pmch_cfg.pdsch_cfg.softbuffers.rx[0] = &_softbuffer;
-  pmch_dec.payload = _payload_buffer;
+  pmch_dec.payload = _payload_buffer.data();
   srsran_softbuffer_rx_reset_tbs(_pmch_cfg.pdsch_cfg.softbuffers.rx[0], _pmch_cfg.pdsch_cfg.grant.tb[0].tbs);
 
-  if (srsran_ue_dl_decode_pmch(&_ue_dl, &_sf_cfg, &_pmch_cfg, &pmch_dec) != 0) {
+  auto ret = decode_pmch(&pmch_dec);
+  _rest._mbsfn_latency.add(_pmch_cfg.pdsch_cfg.grant.tb[0].mcs_idx,
+      static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - entered).count()));
+
+  if (ret != 0) {
     if (mbsfn_cfg.is_mcch) {
       _rest._mcch.errors++;
     } else {
       _rest._mch[mch_idx].errors++;
     }
     spdlog::warn("Error decoding PMCH");
-    _mutex.unlock();
     return -1;
   }
+  _antenna_selector.report_crc(tti, pmch_dec.crc);
+  if (pmch_dec.crc) {
+    _rest._mbsfn_rx_latency.add(_pmch_cfg.pdsch_cfg.grant.tb[0].mcs_idx,
+        static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - received).count()));
+  }
 
   spdlog::trace("PMCH: tti: {}, l_crb={}, tbs={}, mcs={}, crc={}, snr={} dB, n_iter={}\n",
       tti,
@@ -159,14 +344,18 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
          _pmch_cfg.pdsch_cfg.grant.tb[0].tbs / 8,
          _pmch_cfg.pdsch_cfg.grant.tb[0].mcs_idx,
          pmch_dec.crc ? "OK" : "KO",
-         _ue_dl.chest_res.snr_db,
+         _active_ue_dl->chest_res.snr_db,
          pmch_dec.avg_iterations_block);
 
+  // Constellation diagram data (I/Q data of the subcarriers after CE), if requested through the API
+  auto& channel = mbsfn_cfg.is_mcch ? _rest._mcch : _rest._mch[mch_idx];
+  if (channel.WantsData()) {
+    const auto* mch_data = reinterpret_cast<uint8_t*>(_active_ue_dl->pmch.d);
+    channel.SetData(mch_data, _pmch_cfg.pdsch_cfg.grant.nof_re * sizeof(cf_t));
+  }
   if (mbsfn_cfg.is_mcch) {
-    _rest._mcch.SetData(mch_data());
     _rest._mcch.mcs = static_cast<int>(_pmch_cfg.pdsch_cfg.grant.tb[0].mcs_idx);
   } else {
-    _rest._mch[mch_idx].SetData(mch_data());
     _rest._mch[mch_idx].mcs = static_cast<int>(_pmch_cfg.pdsch_cfg.grant.tb[0].mcs_idx);
     _rest._mch[mch_idx].present = true;
   }
@@ -174,16 +363,20 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
   if (pmch_dec.crc) {
     mch_mac_msg.init_rx(
         static_cast<uint32_t>(_pmch_cfg.pdsch_cfg.grant.tb[0].tbs) / 8);
-    mch_mac_msg.parse_packet(_payload_buffer);
+    mch_mac_msg.parse_packet(_payload_buffer.data());
 
     while (mch_mac_msg.next()) {
       if (srsran::mch_lcid::MCH_SCHED_INFO == mch_mac_msg.get()->mch_ce_type()) {
         uint16_t stop = 0;
         uint8_t lcid = 0;
+        auto& sched = _sched_stops[mch_idx % MchReorderBuffer::kMaxMchs];
         while (mch_mac_msg.get()->get_next_mch_sched_info(&lcid, &stop)) {
-          const std::lock_guard<std::mutex> lock(_sched_stop_mutex);
-          spdlog::debug("Scheduling stop for LCID {} in sf {}", lcid, stop);
-          _sched_stops[ lcid ] = stop;
+          if (lcid >= SRSRAN_N_MCH_LCIDS) {
+            continue;
+          }
+          const std::lock_guard<std::mutex> lock(sched.mutex);
+          spdlog::debug("Scheduling stop for LCID {} in sf {} of MCH {}", lcid, stop, mch_idx);
+          sched.stops[ lcid ] = stop;
         }
       } else if (mch_mac_msg.get()->is_sdu()) {
         uint32_t lcid = mch_mac_msg.get()->get_sdu_lcid();
@@ -196,15 +389,10 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
           } else {
             _rest._mch[mch_idx].errors++;
           }
-          _mutex.unlock();
           return -1;
         }
 
-        {
-          const std::lock_guard<std::mutex> lock(_rlc_mutex);
-          _phy._mcs = mbsfn_cfg.mbsfn_mcs;
-          _rlc.write_pdu_mch(mch_idx, lcid, mch_mac_msg.get()->get_sdu_ptr(), mch_mac_msg.get()->get_payload_size());
-        }
+        _output.add_pdu(mch_idx, lcid, mch_mac_msg.get()->get_sdu_ptr(), mch_mac_msg.get()->get_payload_size());
       }
     }
   } else {
@@ -215,54 +403,107 @@ auto MbsfnFrameProcessor::process(uint32_t tti) -> int {
     }
 
     spdlog::warn("PMCH in TTI {} failed with CRC error", tti);
-    _mutex.unlock();
     return -1;
   }
 
-  if (!mbsfn_cfg.is_mcch) {
-    for (uint32_t i = 0; i < _phy.mcch().nof_pmch_info; i++) {
-      unsigned fn_in_scheduling_period =  sfn % srsran::enum_to_number(_phy.mcch().pmch_info_list[i].mch_sched_period);
-      unsigned sf_idx;
-      if (_cell.mbms_dedicated) {
-        sf_idx = fn_in_scheduling_period * 10 + sf - (fn_in_scheduling_period / 4) - 1;
-      } else {
-        sf_idx = fn_in_scheduling_period * 6 + (sf < 6 ? sf - 1 : sf - 3);
-      }
-          spdlog::debug("tti{}, sfn {}, sf {}, fn_in_scheduling_period {}, sf_idf {}", tti, sfn, sf, fn_in_scheduling_period, sf_idx);
-
-      const std::lock_guard<std::mutex> lock(_sched_stop_mutex);
-      for (auto itr = _sched_stops.cbegin() ; itr != _sched_stops.cend() ;) {
-        if ( sf_idx >= itr->second ) {
-          const std::lock_guard<std::mutex> lock(_rlc_mutex);
-          spdlog::debug("Stopping LCID {} in tti {} (idx in rf {})", itr->first, tti, sf_idx);
-          if (!_allow_rrc_sn_across_periods) {
-            _rlc.stop_mch(i, itr->first);
-          }
-          itr = _sched_stops.erase(itr);
-        } else {
-          itr = std::next(itr);
+  if (!mbsfn_cfg.is_mcch && mch_idx < _phy.mcch().nof_pmch_info) {
+    // The stops signalled in the scheduling information of an MCH refer to subframes of its own scheduling period
+    unsigned fn_in_scheduling_period =  sfn % srsran::enum_to_number(_phy.mcch().pmch_info_list[mch_idx].mch_sched_period);
+    unsigned sf_idx;
+    if (_cell.mbms_dedicated) {
+      sf_idx = fn_in_scheduling_period * 10 + sf - (fn_in_scheduling_period / 4) - 1;
+    } else {
+      sf_idx = fn_in_scheduling_period * 6 + (sf < 6 ? sf - 1 : sf - 3);
+    }
+    spdlog::debug("tti{}, sfn {}, sf {}, fn_in_scheduling_period {}, sf_idf {}", tti, sfn, sf, fn_in_scheduling_period, sf_idx);
+
+    auto& sched = _sched_stops[mch_idx % MchReorderBuffer::kMaxMchs];
+    const std::lock_guard<std::mutex> lock(sched.mutex);
+    for (auto lcid = 0U; lcid < SRSRAN_N_MCH_LCIDS; lcid++) {
+      if (sched.stops[lcid] != kNoStop && sf_idx >= sched.stops[lcid]) {
+        spdlog::debug("Stopping LCID {} of MCH {} in tti {} (idx in rf {})", lcid, mch_idx, tti, sf_idx);
+        if (!_allow_rrc_sn_across_periods) {
+          _output.add_stop(mch_idx, lcid);
         }
+        sched.stops[lcid] = kNoStop;
       }
     }
-  } else {
-    _rlc.stop_mch(0, 0);
+  } else if (mbsfn_cfg.is_mcch) {
+    _output.add_stop(0, 0);
     _rest._mcch.present = true;
   }
-  _mutex.unlock();
   return mbsfn_cfg.is_mcch ? 0 : 1;
 }
 
-void MbsfnFrameProcessor::configure_mbsfn(uint8_t area_id, srsran_scs_t subcarrier_spacing) {
-  _sf_cfg.subcarrier_spacing = subcarrier_spacing;
-  srsran_ue_dl_set_mbsfn_subcarrier_spacing(&_ue_dl, subcarrier_spacing);
+auto MbsfnFrameProcessor::decode_pmch(srsran_pdsch_res_t* pmch_dec) -> int {
+  if (!_cb_decoder.parallelize(_pmch_cfg.pdsch_cfg)) {
+    return srsran_ue_dl_decode_pmch(_active_ue_dl, &_sf_cfg, &_pmch_cfg, pmch_dec);
+  }
 
+  // First pass: demodulation and LLR calculation only. All code blocks are marked as
+  // already decoded, so srsran does not run the turbo decoder.
+  srsran_cbsegm_t cb_segm = {};
+  srsran_cbsegm(&cb_segm, static_cast<uint32_t>(_pmch_cfg.pdsch_cfg.grant.tb[0].tbs));
+  for (auto i = 0U; i < cb_segm.C; i++) {
+    _softbuffer.cb_crc[i] = true;
+  }
+  if (srsran_ue_dl_decode_pmch(_active_ue_dl, &_sf_cfg, &_pmch_cfg, pmch_dec) != 0) {
+    return -1;
+  }
 
-  srsran_ue_dl_set_mbsfn_area_id(&_ue_dl, area_id);
-  _area_id = area_id;
-  _mbsfn_configured = true;
+  // Decode the code blocks on idle workers...
+  auto e_bits = static_cast<int16_t*>(_active_ue_dl->pmch.e);
+  auto failed = _cb_decoder.decode(_pmch_cfg.pdsch_cfg, e_bits, pmch_dec->avg_iterations_block);
+
+  // ...and let srsran assemble the TB from the softbuffer and check its CRC. A failed code block fails the TB,
+  // so there is no need to run the decoder on it once more.
+  pmch_dec->crc = failed == 0 &&
+    srsran_dlsch_decode(&_active_ue_dl->pmch.dl_sch, &_pmch_cfg.pdsch_cfg, e_bits, pmch_dec->payload) == SRSRAN_SUCCESS;
+  return 0;
 }
 
-auto MbsfnFrameProcessor::mch_data() const -> std::vector<uint8_t> const {
-  const uint8_t* data = reinterpret_cast<uint8_t*>(_ue_dl.pmch.d);
-  return std::vector<uint8_t>( data, data + _pmch_cfg.pdsch_cfg.grant.nof_re * sizeof(cf_t));
+auto MbsfnFrameProcessor::configure(const std::shared_ptr<const CellContext>& context) -> bool {
+  if (context == _cell_context) {
+    return true;
+  }
+  _cell_context.reset();
+
+  // The MBSFN FFTs are the only ones large enough to be worth splitting across pool threads
+  const ParallelFft::Planning planning;
+
+  _cell = context->mbsfn_cell();
+  if (!resize(_cell.nof_prb, context->rx_buffer_samples())) {
+    return false;
+  }
+  srsran_ue_dl_set_cell(&_ue_dl, _cell);
+  if (_has_ue_dl_single) {
+    srsran_ue_dl_set_cell(&_ue_dl_single, _cell);
+  }
+  _rs_area_id = -1;
+
+  _sf_cfg.subcarrier_spacing = context->subcarrier_spacing();
+  srsran_ue_dl_set_mbsfn_subcarrier_spacing(&_ue_dl, context->subcarrier_spacing());
+  if (_has_ue_dl_single) {
+    srsran_ue_dl_set_mbsfn_subcarrier_spacing(&_ue_dl_single, context->subcarrier_spacing());
+  }
+
+  set_rs_area_id(context->area_id());
+  _area_id = context->area_id();
+  _cell_context = context;
+  return true;
+}
+
+void MbsfnFrameProcessor::set_rs_area_id(uint8_t area_id) {
+  // Generating the MBSFN reference signals is expensive, and they only depend on the cell,
+  // subcarrier spacing and area. Only regenerate them if the area has changed.
+  // Each processor still holds its own copy: the tables live inside srsran's chest_dl and
+  // are not shared between processors.
+  if (_rs_area_id == area_id) {
+    return;
+  }
+  srsran_ue_dl_set_mbsfn_area_id(&_ue_dl, area_id);
+  if (_has_ue_dl_single) {
+    srsran_ue_dl_set_mbsfn_area_id(&_ue_dl_single, area_id);
+  }
+  _rs_area_id = area_id;
 }
@@ -19,11 +19,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <thread>
 #include <vector>
 #include <map>
+#include <memory>
 #include "srsran/srsran.h"
 #include "srsran/rlc/rlc.h"
 #include "srsran/upper/pdcp.h"
@@ -31,6 +35,12 @@
 #include <libconfig.h++>
 #include "Phy.h"
 #include "RestHandler.h"
+#include "AntennaSelector.h"
+#include "CellContext.h"
+#include "ChannelStateStore.h"
+#include "CodeblockDecoder.h"
+#include "HugePageArena.h"
+#include "MchReorderBuffer.h"
 
 /**
  *  Frame processor for MBSFN subframes. Handles the complete processing chain for
@@ -43,19 +53,29 @@ class MbsfnFrameProcessor {
      *
      *  @param cfg Config singleton reference
      *  @param phy PHY reference
-     *  @param rlc RLC reference
      *  @param log_h srsLTE log handle for the MCH MAC msg decoder
      *  @param rest RESTful API handler reference
+     *  @param cb_decoder Parallel code block decoder
+     *  @param ce_store Channel estimate shared between the processors
+     *  @param reorder Passes the decoded PDUs to RLC in TTI order
+     *  @param antenna_selector Selects single antenna or combined decoding
+     *  @param arena Memory arena for the sample buffers
      */
-    MbsfnFrameProcessor(const libconfig::Config& cfg, srsran::rlc& rlc, Phy& phy, srslog::basic_logger& log_h, RestHandler& rest, unsigned rx_channels )
-      : _rlc(rlc)
-      , _phy(phy)
+    MbsfnFrameProcessor(const libconfig::Config& cfg, Phy& phy, srslog::basic_logger& log_h, RestHandler& rest, CodeblockDecoder& cb_decoder, ChannelStateStore& ce_store, MchReorderBuffer& reorder, AntennaSelector& antenna_selector, HugePageArena& arena, unsigned rx_channels )
+      : _phy(phy)
       , mch_mac_msg(20, log_h)
       , _rest(rest)
+      , _cb_decoder(cb_decoder)
+      , _ce_store(ce_store)
+      , _reorder(reorder)
+      , _antenna_selector(antenna_selector)
+      , _arena(arena)
       , _rx_channels(rx_channels)
       {
         _allow_rrc_sn_across_periods = false;
         cfg.lookupValue("modem.phy.allow_rrc_sn_across_periods", _allow_rrc_sn_across_periods);
+        cfg.lookupValue("modem.phy.mbsfn_batch_size", _batch_size);
+        _batch_size = std::max(_batch_size, 1U);
       }
 
     /**
@@ -64,100 +84,155 @@ class MbsfnFrameProcessor {
     virtual ~MbsfnFrameProcessor();
 
     /**
-     *  Initialize signal- and softbuffers, init all underlying components. 
-     *  Must be called once before the first call to process().
+     *  Initialize the static processing parameters.
+     *  Must be called once before the first call to configure_mbsfn().
      */
     bool init();
 
     /**
-     *  Process the sample data in the signal buffer. Data must already be present in the buffer
-     *  obtained through the handle returnd by rx_buffer()
+     *  Process all subframes in the current batch.
+     *  Sample data must already be present in the buffers obtained through rx_buffer(), and
+     *  each subframe must have been added with add_to_batch().
      *
-     *  @param tti TTI of the subframe the data belongs to
+     *  Returns the number of successfully decoded subframes.
      */
-    int process(uint32_t tti);
+    int process();
 
     /**
-     *  Set the parameters for the cell (Nof PRB, etc).
-     * 
-     *  @param cell The cell we're camping on
+     *  Drop all subframes in the current batch without processing them.
+     *  Their reorder buffer tickets are completed with no PDUs, so later subframes are not held up.
      */
-    void set_cell(srsran_cell_t cell);
+    void discard_batch();
 
     /**
-     *  Get a handle of the signal buffer to store samples for processing in, 
-     *  and lock this processor.
+     *  Start a new, empty batch.
      *
-     *  The processor unlocks itself after (failed or successful) frame processing in process().
-     *  If process() is not called by the application after calling this method, it must unlock the 
-     *  processor itself by calling unlock()
+     *  Must only be called by the current owner of the processor, after acquiring it from its ProcessorPool.
      */
-    cf_t** get_rx_buffer_and_lock() { _mutex.lock(); return _signal_buffer_rx; }
+    void start_batch() { _batch_len = 0; }
 
     /**
-     *  Size of the signal buffer
+     *  Get a handle of the signal buffer for the next subframe of the batch to store samples in.
      */
-    uint32_t rx_buffer_size() { return _signal_buffer_max_samples; }
+    cf_t** rx_buffer() { return _batch_buffers[_batch_len].data(); }
+
+    /**
+     *  Add the subframe in the buffer returned by rx_buffer() to the batch.
+     *
+     *  All subframes in a batch must share the same MBSFN configuration (MCH, MCS).
+     *
+     *  @param tti TTI of the subframe the data belongs to
+     *  @param received Time the last sample of the subframe was received from the SDR
+     *  @param samples Nr of samples per antenna stored in the buffer
+     *  @param ticket Position of the subframe in the MchReorderBuffer
+     */
+    void add_to_batch(uint32_t tti, std::chrono::steady_clock::time_point received, uint32_t samples, MchReorderBuffer::ticket_t ticket) {
+      _batch_received[_batch_len] = received;
+      _batch_samples[_batch_len] = samples;
+      _batch_tickets[_batch_len] = ticket;
+      _batch_ttis[_batch_len++] = tti;
+    }
+
+    /**
+     *  Returns true if no more subframes can be added to the batch
+     */
+    bool batch_full() { return _batch_len >= _batch_size; }
 
     /**
-     *  Set MBSFN parameters: area ID and subcarrier spacing
+     *  Returns true if the batch does not contain any subframes
      */
-    void configure_mbsfn(uint8_t area_id, srsran_scs_t subcarrier_spacing);
+    bool batch_empty() { return _batch_len == 0; }
 
     /**
-     *  Returns tru if MBSFN params have already been configured
+     *  Size of the signal buffer
      */
-    bool mbsfn_configured() { return _mbsfn_configured; }
+    uint32_t rx_buffer_size() { return _signal_buffer_max_samples; }
 
     /**
-     *  Unlock the processor
+     *  Set the parameters for the cell (Nof PRB, etc), MBSFN area and subcarrier spacing.
+     *  Does nothing if the processor is already configured with this context.
+     *
+     *  Signal buffers, ue_dl and softbuffer are (re)allocated to fit the bandwidth of the cell
+     *  and the subcarrier spacing if either has changed.
      *
-     *  @see get_rx_buffer_and_lock() 
+     *  @param context Cell context shared by all processors
      */
-    void unlock() { _mutex.unlock(); }
+    bool configure(const std::shared_ptr<const CellContext>& context);
 
     /**
-     *  Get the constellation diagram data (I/Q data of the subcarriers after CE)
+     *  The cell context the processor is currently configured with, nullptr if none
      */
-    const std::vector<uint8_t> mch_data() const;
+    const std::shared_ptr<const CellContext>& cell_context() { return _cell_context; }
 
     /**
      *  Get the CINR estimate (in dB)
      */
-    float cinr_db() { return _ue_dl.chest_res.snr_db; }
+    float cinr_db() { return _active_ue_dl->chest_res.snr_db; }
 
   private:
-    srsran::rlc& _rlc;
+    int process_subframe(uint32_t tti, std::chrono::steady_clock::time_point received, const srsran_mbsfn_cfg_t& mbsfn_cfg, unsigned mch_idx);
+    int decode_pmch(srsran_pdsch_res_t* pmch_dec);
+    bool resize(uint32_t nof_prb, uint32_t samples);
+    void free_buffers();
+    bool prepare_tb_buffers(uint32_t tbs);
+    void set_rs_area_id(uint8_t area_id);
+    static size_t softbuffer_size(const srsran_softbuffer_rx_t& softbuffer);
+
     Phy& _phy;
 
-    srsran_cell_t _cell;
+    std::shared_ptr<const CellContext> _cell_context;
+    srsran_cell_t _cell = {};
+    uint32_t _allocated_prb = 0;
 
     cf_t*    _signal_buffer_rx[SRSRAN_MAX_PORTS] = {};
     uint32_t _signal_buffer_max_samples          = 0;
 
-    static const uint32_t  _payload_buffer_sz = SRSRAN_MAX_BUFFER_SIZE_BYTES;
-    uint8_t                _payload_buffer[_payload_buffer_sz];
-    srsran_softbuffer_rx_t _softbuffer;
+    unsigned _batch_size = 1;
+    unsigned _batch_len = 0;
+    std::vector<std::array<cf_t*, SRSRAN_MAX_PORTS>> _batch_buffers;
+    std::vector<uint32_t> _batch_ttis;
+    std::vector<std::chrono::steady_clock::time_point> _batch_received;
+    std::vector<uint32_t> _batch_samples;
+    std::vector<MchReorderBuffer::ticket_t> _batch_tickets;
+
+    std::vector<uint8_t>   _payload_buffer;
+    srsran_softbuffer_rx_t _softbuffer = {};
+    bool _has_softbuffer = false;
 
     srsran_ue_dl_t     _ue_dl     = {};
+    bool _has_ue_dl = false;
+    srsran_ue_dl_t     _ue_dl_single = {};  /**< Decodes from one antenna only, if antenna selection is enabled */
+    bool _has_ue_dl_single = false;
+    srsran_ue_dl_t*    _active_ue_dl = &_ue_dl;
     srsran_ue_dl_cfg_t _ue_dl_cfg = {};
     srsran_dl_sf_cfg_t _sf_cfg = {};
     srsran_pmch_cfg_t  _pmch_cfg  = {};
 
     uint8_t _area_id = 1;
-    bool _mbsfn_configured = false;
+    int _rs_area_id = -1;  /**< Area the MBSFN reference signals in ue_dl were generated for, -1 if none */
 
     srsran::mch_pdu mch_mac_msg;
-    std::mutex _mutex;
 
     RestHandler& _rest;
+    CodeblockDecoder& _cb_decoder;
+    ChannelStateStore& _ce_store;
+    MchReorderBuffer& _reorder;
+    MchReorderBuffer::Entry _output;  /**< PDUs of the subframe being processed */
+    AntennaSelector& _antenna_selector;
+    HugePageArena& _arena;
 
     unsigned _rx_channels;
 
     bool _allow_rrc_sn_across_periods = false;
-    static std::mutex _sched_stop_mutex;
-    static std::map<uint8_t, uint16_t> _sched_stops;
-
-    static std::mutex _rlc_mutex;
-    static int _current_mcs;
+    static constexpr uint32_t kNoStop = UINT32_MAX;
+    /**
+     *  MTCH stops from the MCH scheduling information, by MCH. Shared by all processors.
+     *  A fixed table by LCID, so updating it does not allocate.
+     */
+    struct sched_stops_t {
+      std::mutex mutex;
+      std::array<uint32_t, SRSRAN_N_MCH_LCIDS> stops;  /**< LCID -> index of the last subframe in the scheduling period */
+      sched_stops_t() { stops.fill(kNoStop); }
+    };
+    static std::array<sched_stops_t, MchReorderBuffer::kMaxMchs> _sched_stops;
 };
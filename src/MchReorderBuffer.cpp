@@ -0,0 +1,225 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "MchReorderBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "spdlog/spdlog.h"
+#include "thread_pool.hpp"
+
+void MchReorderBuffer::Entry::add_pdu(uint32_t mch_idx, uint32_t lcid, const uint8_t* data, uint32_t len) {
+  auto offset = static_cast<uint32_t>(_data.size());
+  _data.resize(offset + len);
+  memcpy(_data.data() + offset, data, len);
+  _items.push_back({false, mch_idx, lcid, offset, len});
+}
+
+void MchReorderBuffer::Entry::add_stop(uint32_t mch_idx, uint32_t lcid) {
+  _items.push_back({true, mch_idx, lcid, 0, 0});
+}
+
+MchReorderBuffer::MchReorderBuffer(const libconfig::Config& cfg, srsran::rlc& rlc, RestHandler& rest, thread_pool& pool)
+  : _rlc(rlc)
+  , _rest(rest)
+  , _pool(pool)
+{
+  unsigned max_wait_ms = 20;
+  cfg.lookupValue("modem.phy.mch_reorder.enabled", _enabled);
+  cfg.lookupValue("modem.phy.mch_reorder.max_wait_ms", max_wait_ms);
+  cfg.lookupValue("modem.phy.mch_reorder.shard_by_mch", _shard_by_mch);
+  _max_wait = std::chrono::milliseconds(max_wait_ms);
+
+  for (auto i = 0U; i < kLanes; i++) {
+    _lanes.push_back(std::make_unique<lane_t>());
+  }
+  _free_entries.reserve(kEntries);
+  for (auto i = 0U; i < kEntries; i++) {
+    _entries.push_back(std::make_unique<Entry>());
+    _free_entries.push_back(_entries.back().get());
+  }
+}
+
+auto MchReorderBuffer::take_entry() -> Entry* {
+  const std::lock_guard<std::mutex> lock(_entries_mutex);
+  if (_free_entries.empty()) {
+    spdlog::debug("MCH reorder: more than {} subframes waiting for delivery, adding an entry", _entries.size());
+    _entries.push_back(std::make_unique<Entry>());
+    _free_entries.reserve(_entries.size());
+    return _entries.back().get();
+  }
+  auto entry = _free_entries.back();
+  _free_entries.pop_back();
+  return entry;
+}
+
+void MchReorderBuffer::return_entry(Entry* entry) {
+  entry->clear();
+  const std::lock_guard<std::mutex> lock(_entries_mutex);
+  _free_entries.push_back(entry);
+}
+
+auto MchReorderBuffer::expect(bool is_mcch, unsigned mch_idx) -> ticket_t {
+  if (!_enabled) {
+    return {0, kUntracked};
+  }
+  // Without sharding, all subframes share the MCCH lane and are delivered in one global order
+  unsigned lane_idx = (!_shard_by_mch || is_mcch) ? 0 : 1 + std::min(mch_idx, kMaxMchs - 1);
+  auto& lane = *_lanes[lane_idx];
+
+  // Delivery must not run on the main loop. Only skip subframes that have been waited for too long here,
+  // and leave delivering what follows them to a pool thread. If another thread is draining the lane,
+  // it skips them itself.
+  if (!lane.draining.test_and_set(std::memory_order_acquire)) {
+    auto head = lane.head.load(std::memory_order_relaxed);
+    while (skip_expired(lane, head)) {}
+    lane.draining.clear(std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);  // pairs with the one in complete()
+    if (head != lane.tail.load(std::memory_order_acquire) &&
+        lane.slots[head % kSlots].state.load(std::memory_order_acquire) == tag(head, kReady)) {
+      _pool.post([this, lane_idx] { drain(lane_idx); });
+    }
+  }
+
+  auto seq = lane.tail.load(std::memory_order_relaxed);
+  auto& slot = lane.slots[seq % kSlots];
+  if ((slot.state.load(std::memory_order_acquire) & 3U) != kFree) {
+    // The oldest subframe is still waiting for delivery. This one bypasses the ring and is dropped.
+    _rest._mch_reorder.overflows++;
+    return {lane_idx, kUntracked};
+  }
+  slot.expected_at = std::chrono::steady_clock::now();
+  slot.state.store(tag(seq, kPending), std::memory_order_release);
+  lane.tail.store(seq + 1, std::memory_order_release);
+
+  auto depth = _rest._mch_reorder.depth.fetch_add(1, std::memory_order_relaxed) + 1;
+  auto max = _rest._mch_reorder.max_depth.load(std::memory_order_relaxed);
+  while (depth > max && !_rest._mch_reorder.max_depth.compare_exchange_weak(max, depth, std::memory_order_relaxed)) {}
+  return {lane_idx, seq};
+}
+
+void MchReorderBuffer::complete(ticket_t ticket, Entry& entry) {
+  if (ticket.seq == kUntracked) {
+    if (!_enabled) {
+      deliver(ticket.lane, entry);
+    }
+    entry.clear();
+    return;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  auto& slot = _lanes[ticket.lane]->slots[ticket.seq % kSlots];
+  auto pending = tag(ticket.seq, kPending);
+  if (!slot.state.compare_exchange_strong(pending, tag(ticket.seq, kFilling), std::memory_order_acquire)) {
+    // Skipped after waiting too long, the RLC has moved on
+    _rest._mch_reorder.late++;
+    entry.clear();
+    return;
+  }
+  // Copied, so the processor's buffers stay sized for its TBs, and the pooled ones keep their capacity
+  slot.entry = take_entry();
+  slot.entry->_items = entry._items;
+  slot.entry->_data = entry._data;
+  entry.clear();
+  slot.state.store(tag(ticket.seq, kReady), std::memory_order_release);
+  // Either this thread takes the draining flag, or the one letting go of it sees the slot ready
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  drain(ticket.lane);
+  _rest._mch_delivery_latency.add(ticket.lane,
+      static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count()));
+}
+
+void MchReorderBuffer::drain(unsigned lane_idx) {
+  auto& lane = *_lanes[lane_idx];
+  // Only one thread delivers per lane at a time. If the head becomes ready while it is finishing, it
+  // may have missed it, so it checks again after letting go.
+  for (;;) {
+    if (lane.draining.test_and_set(std::memory_order_acquire)) {
+      _rest._mch_reorder.contended++;
+      return;
+    }
+    auto head = lane.head.load(std::memory_order_relaxed);
+    while (head != lane.tail.load(std::memory_order_acquire)) {
+      auto& slot = lane.slots[head % kSlots];
+      auto state = slot.state.load(std::memory_order_acquire);
+      if (state == tag(head, kReady)) {
+        deliver(lane_idx, *slot.entry);
+        return_entry(slot.entry);
+        slot.entry = nullptr;
+        _rest._mch_reorder.delivered++;
+      } else if (skip_expired(lane, head)) {
+        continue;
+      } else {
+        break;
+      }
+      slot.state.store(tag(head, kFree), std::memory_order_release);
+      lane.head.store(++head, std::memory_order_release);
+      _rest._mch_reorder.depth.fetch_sub(1, std::memory_order_relaxed);
+    }
+    lane.draining.clear(std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);  // pairs with the one in complete()
+
+    if (head == lane.tail.load(std::memory_order_acquire) ||
+        lane.slots[head % kSlots].state.load(std::memory_order_acquire) != tag(head, kReady)) {
+      return;
+    }
+  }
+}
+
+auto MchReorderBuffer::skip_expired(lane_t& lane, uint64_t& head) -> bool {
+  // Must hold the lane's draining flag
+  if (head == lane.tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+  auto& slot = lane.slots[head % kSlots];
+  auto state = tag(head, kPending);
+  auto waited = std::chrono::steady_clock::now() - slot.expected_at;
+  if (slot.state.load(std::memory_order_acquire) != state || waited <= _max_wait ||
+      !slot.state.compare_exchange_strong(state, tag(head, kFree), std::memory_order_relaxed)) {
+    return false;
+  }
+  spdlog::debug("MCH reorder: giving up on subframe after {} ms",
+      std::chrono::duration_cast<std::chrono::milliseconds>(waited).count());
+  _rest._mch_reorder.skipped++;
+  lane.head.store(++head, std::memory_order_release);
+  _rest._mch_reorder.depth.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+void MchReorderBuffer::deliver(unsigned lane_idx, Entry& entry) {
+  // The MCCH lane, which also carries all subframes if reordering is disabled or not sharded, may reconfigure
+  // the bearers. The MCH lanes only write to their own bearers, and are drained by one thread each.
+  std::shared_lock<std::shared_mutex> mch_lock(_rrc_mutex, std::defer_lock);
+  std::unique_lock<std::shared_mutex> mcch_lock(_rrc_mutex, std::defer_lock);
+  if (lane_idx == 0) {
+    mcch_lock.lock();
+  } else {
+    mch_lock.lock();
+  }
+  for (const auto& item : entry._items) {
+    if (item.stop) {
+      _rlc.stop_mch(item.mch_idx, item.lcid);
+    } else {
+      _rlc.write_pdu_mch(item.mch_idx, item.lcid, entry._data.data() + item.offset, item.len);
+    }
+  }
+}
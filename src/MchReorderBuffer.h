@@ -0,0 +1,219 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+#include <libconfig.h++>
+#include "srsran/rlc/rlc.h"
+#include "RestHandler.h"
+
+class thread_pool;
+
+/**
+ *  Hands the MCH PDUs of MBSFN subframes to RLC in TTI order.
+ *
+ *  MBSFN subframes are decoded in parallel and complete in any order, but RLC UM reassembles SDUs
+ *  that span subframes only from PDUs that arrive in sequence. The main loop registers every MBSFN
+ *  subframe with expect() in TTI order, and the processor that decoded it passes its PDUs to
+ *  complete(). PDUs are delivered to RLC once all earlier subframes have been completed.
+ *
+ *  Only the subframes of the same MCH need to be kept in order, as each MCH carries its own bearers.
+ *  Subframes are therefore ordered in one lane per MCH (and one for the MCCH), and the MCH lanes deliver
+ *  in parallel. Each MCH carries its own RLC bearers, so they don't share RLC state. MCCH delivery reaches
+ *  RRC, which adds and removes those bearers, so the MCCH lane delivers exclusively of all others.
+ *
+ *  In each lane, subframes are kept in a ring of slots, indexed by a sequence number assigned in expect().
+ *  Each slot has an atomic state tagged with its sequence number, so the main loop, the processors and the
+ *  delivering thread hand slots over through atomics. Whichever thread completes the oldest subframe of a
+ *  lane delivers, while the others only deposit their PDUs. Locks are only taken around the pool of
+ *  entries holding completed PDUs, and around delivery to RLC.
+ *
+ *  A completing thread publishes its slot and then tries to take the lane's draining flag, while a thread
+ *  letting go of the flag checks the head slot afterwards. Both sides are separated by seq_cst fences, so
+ *  at least one of them sees the other, and a completed head is never left undelivered.
+ *
+ *  A subframe that has not been completed within the maximum wait time is skipped, so a stuck
+ *  processor cannot hold up delivery. Its PDUs are dropped if it completes later. The main loop only
+ *  skips, it never delivers: if skipping makes completed subframes deliverable, a pool thread delivers them.
+ */
+class MchReorderBuffer {
+  public:
+    /**
+     *  Sequence number of subframes that are not reordered
+     */
+    static const uint64_t kUntracked = UINT64_MAX;
+
+    /**
+     *  Max nr of MCHs in an MBSFN area (PMCH-InfoList)
+     */
+    static const unsigned kMaxMchs = 15;
+
+    /**
+     *  Nr of lanes: one for the MCCH, one per MCH
+     */
+    static const unsigned kLanes = kMaxMchs + 1;
+
+    /**
+     *  Position of a subframe in the reorder buffer, returned by expect()
+     */
+    typedef struct {
+      unsigned lane;
+      uint64_t seq;
+    } ticket_t;
+
+    /**
+     *  Output of one MBSFN subframe: MCH PDUs and MTCH stops, in the order they are to be applied to RLC.
+     *  Processors fill it while decoding and pass it to complete(). The buffers keep their capacity.
+     */
+    class Entry {
+      public:
+        /**
+         *  Max nr of PDUs and stops per subframe: the MAC subheaders of an MCH PDU, plus a stop per LCID
+         */
+        static const unsigned kMaxItems = 64;
+
+        Entry() { _items.reserve(kMaxItems); }
+
+        /**
+         *  Make room for the PDUs of a TB of the given size, so adding them does not allocate.
+         */
+        void reserve(uint32_t bytes) { _data.reserve(bytes); }
+
+        /**
+         *  Add an MCH PDU. The data is copied.
+         */
+        void add_pdu(uint32_t mch_idx, uint32_t lcid, const uint8_t* data, uint32_t len);
+
+        /**
+         *  Add a stop of an MTCH (end of its scheduling period)
+         */
+        void add_stop(uint32_t mch_idx, uint32_t lcid);
+
+        /**
+         *  Remove all PDUs and stops
+         */
+        void clear() { _items.clear(); _data.clear(); }
+
+      private:
+        friend class MchReorderBuffer;
+        typedef struct {
+          bool stop;
+          uint32_t mch_idx;
+          uint32_t lcid;
+          uint32_t offset;
+          uint32_t len;
+        } item_t;
+        std::vector<item_t> _items;
+        std::vector<uint8_t> _data;
+    };
+
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param rlc RLC to deliver the PDUs to
+     *  @param rest RESTful API handler the counters are reported to
+     *  @param pool PHY thread pool, to deliver subframes on that became deliverable in expect()
+     */
+    MchReorderBuffer(const libconfig::Config& cfg, srsran::rlc& rlc, RestHandler& rest, thread_pool& pool);
+
+    /**
+     *  Register the next MBSFN subframe. Must be called from the main loop, in TTI order.
+     *  Also skips the oldest pending subframes of its lane if they have been waited for too long,
+     *  without delivering anything on the calling thread.
+     *
+     *  @param is_mcch The subframe carries the MCCH
+     *  @param mch_idx Index of the MCH the subframe belongs to, if it does not carry the MCCH
+     *  @return Ticket to pass to complete(). Its seq is kUntracked if reordering is disabled or the ring is full.
+     */
+    ticket_t expect(bool is_mcch, unsigned mch_idx);
+
+    /**
+     *  Pass the output of a subframe. Can be called from any thread but the main loop, exactly once
+     *  per expect(). Delivers it, and any subframes of the same lane completed after it, to RLC if all
+     *  earlier subframes of the lane are done. Subframes that are dropped undecoded are completed with
+     *  an empty entry, so later ones are not held up.
+     *
+     *  @param ticket Ticket returned by expect()
+     *  @param entry PDUs of the subframe. Its contents are taken over, it is empty on return.
+     */
+    void complete(ticket_t ticket, Entry& entry);
+
+  private:
+    enum : uint64_t { kFree = 0, kPending = 1, kFilling = 2, kReady = 3 };
+    static uint64_t tag(uint64_t seq, uint64_t status) { return (seq << 2U) | status; }
+
+    /**
+     *  Ring size. Must exceed the nr of subframes that arrive within the maximum wait time.
+     */
+    static const unsigned kSlots = 256;
+
+    /**
+     *  Nr of preallocated entries for completed subframes waiting for delivery. More are allocated if needed.
+     */
+    static const unsigned kEntries = 64;
+
+    struct slot_t {
+      std::atomic<uint64_t> state = {kFree};
+      std::chrono::steady_clock::time_point expected_at;
+      Entry* entry = nullptr;  /**< Holds the PDUs while the slot is ready */
+    };
+
+    struct lane_t {
+      std::array<slot_t, kSlots> slots;
+      std::atomic<uint64_t> head = {0};  /**< Next subframe to deliver */
+      std::atomic<uint64_t> tail = {0};  /**< Next sequence number to assign, only written by expect() */
+      std::atomic_flag draining = ATOMIC_FLAG_INIT;
+    };
+
+    void drain(unsigned lane_idx);
+    bool skip_expired(lane_t& lane, uint64_t& head);
+    void deliver(unsigned lane_idx, Entry& entry);
+    Entry* take_entry();
+    void return_entry(Entry* entry);
+
+    srsran::rlc& _rlc;
+    RestHandler& _rest;
+    thread_pool& _pool;
+
+    bool _enabled = true;
+    bool _shard_by_mch = true;
+    std::chrono::microseconds _max_wait = std::chrono::milliseconds(20);
+
+    std::vector<std::unique_ptr<lane_t>> _lanes;
+
+    /**
+     *  Entries are only held by ready slots, and reused most recently returned first, so the buffers
+     *  of the few in use at a time keep their capacity.
+     */
+    std::mutex _entries_mutex;
+    std::vector<std::unique_ptr<Entry>> _entries;
+    std::vector<Entry*> _free_entries;
+
+    std::shared_mutex _rrc_mutex;  /**< Held shared by the MCH lanes while delivering, and exclusively by the MCCH lane */
+};
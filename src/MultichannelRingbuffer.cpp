@@ -19,6 +19,7 @@
 
 #include "MultichannelRingbuffer.h"
 
+#include <algorithm>
 #include <memory>
 #include "spdlog/spdlog.h"
 
@@ -35,6 +36,7 @@ MultichannelRingbuffer::MultichannelRingbuffer(size_t size, size_t channels) //N
     }
     _buffers.push_back(buf);
   }
+  _write_heads.resize(_channels, nullptr);
   spdlog::debug("Created {}-channel ringbuffer with size {}", _channels, _size );
 }
 
@@ -45,13 +47,14 @@ MultichannelRingbuffer::~MultichannelRingbuffer()
   }
 }
 
-auto MultichannelRingbuffer::write_head(size_t* writeable) -> std::vector<void*>
+auto MultichannelRingbuffer::write_head(size_t* writeable) -> std::vector<void*>&
 {
 //  _mutex.lock();
   std::lock_guard<std::mutex> lock(_mutex);
-  std::vector<void*> buffers(_channels, nullptr);
+  auto& buffers = _write_heads;
   if (_size == _used) {
     *writeable = 0;
+    std::fill(buffers.begin(), buffers.end(), nullptr);
   } else {
     auto tail = (_head + _used) % _size;
     if (tail < _head) {
@@ -75,7 +78,7 @@ auto MultichannelRingbuffer::commit(size_t written) -> void
 //  _mutex.unlock();
 }
 
-auto MultichannelRingbuffer::read(std::vector<char*> dest, size_t size) -> void
+auto MultichannelRingbuffer::read(const std::vector<char*>& dest, size_t size) -> void
 {
   assert(dest.size() >= _channels);
   assert(size <= used_size());
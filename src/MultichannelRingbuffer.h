@@ -33,13 +33,14 @@ class MultichannelRingbuffer {
 
     inline void clear() {std::lock_guard<std::mutex> lock(_mutex); _head = _used = 0; };
 
-    std::vector<void*> write_head(size_t* writeable);
+    std::vector<void*>& write_head(size_t* writeable);
     void commit(size_t written);
 
-    void read(std::vector<char*> dest, size_t bytes);
+    void read(const std::vector<char*>& dest, size_t bytes);
 
  private:
     std::vector<char*> _buffers;
+    std::vector<void*> _write_heads;
     size_t _size;
     size_t _channels;
     size_t _used;
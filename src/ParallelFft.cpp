@@ -0,0 +1,173 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "ParallelFft.h"
+
+#include <fftw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+
+#include "spdlog/spdlog.h"
+#include "thread_pool.hpp"
+
+static thread_local unsigned helpers_on_thread = 0;
+
+/**
+ *  One parallel loop of an FFT execution, shared between the executing thread and its helpers.
+ *  Helpers that start after all chunks have been taken return without touching the job data.
+ */
+struct ParallelFft::job_t {
+  std::atomic<unsigned> refs = {0};
+
+  void* (*work)(char*) = nullptr;
+  char* jobdata = nullptr;
+  size_t elsize = 0;
+  int njobs = 0;
+
+  std::atomic<int> next = {0};
+  std::atomic<int> done = {0};
+  std::atomic<unsigned> helpers = {0};
+
+  std::mutex mutex;
+  std::condition_variable finished;
+};
+
+std::mutex ParallelFft::_planning_mutex;
+int ParallelFft::_planning_threads = 1;
+
+ParallelFft::ParallelFft(const libconfig::Config& cfg, thread_pool& pool)
+  : _pool(pool)
+{
+  cfg.lookupValue("modem.phy.parallel_fft", _enabled);
+}
+
+ParallelFft::~ParallelFft() = default;
+
+auto ParallelFft::init() -> bool {
+  if (!_enabled) {
+    return true;
+  }
+#ifdef HAVE_FFTW_THREADS_CALLBACK
+  if (fftwf_init_threads() == 0) {
+    spdlog::error("Could not initialize FFTW threads");
+    return false;
+  }
+  _jobs = std::make_unique<JobSlots<job_t>>(4 * _pool.thread_count());
+  fftwf_threads_set_callback(&ParallelFft::parallel_loop, this);
+  _planning_threads = static_cast<int>(_pool.thread_count());
+  spdlog::info("Parallel MBSFN FFTs enabled with up to {} threads", _pool.thread_count());
+#else
+  spdlog::warn("Parallel FFTs need FFTW 3.3.9 or later, running all FFTs single-threaded");
+#endif
+  return true;
+}
+
+ParallelFft::Planning::Planning()
+  : _lock(_planning_mutex)
+{
+#ifdef HAVE_FFTW_THREADS_CALLBACK
+  if (_planning_threads > 1) {
+    fftwf_plan_with_nthreads(_planning_threads);
+  }
+#endif
+}
+
+ParallelFft::Planning::~Planning() {
+#ifdef HAVE_FFTW_THREADS_CALLBACK
+  if (_planning_threads > 1) {
+    fftwf_plan_with_nthreads(1);
+  }
+#endif
+}
+
+auto ParallelFft::helpers_used(bool reset) -> unsigned {
+  auto helpers = helpers_on_thread;
+  if (reset) {
+    helpers_on_thread = 0;
+  }
+  return helpers;
+}
+
+void ParallelFft::parallel_loop(void* (*work)(char*), char* jobdata, size_t elsize, int njobs, void* data) {
+  auto self = static_cast<ParallelFft*>(data);
+  if (njobs <= 1) {
+    for (auto i = 0; i < njobs; i++) {
+      work(jobdata + elsize * i);
+    }
+    return;
+  }
+
+  auto job = self->_jobs->acquire();
+  if (job == nullptr) {
+    // All job slots are busy, so there would be no idle workers to help anyway
+    for (auto i = 0; i < njobs; i++) {
+      work(jobdata + elsize * i);
+    }
+    return;
+  }
+  job->work = work;
+  job->jobdata = jobdata;
+  job->elsize = elsize;
+  job->njobs = njobs;
+  job->next = 0;
+  job->done = 0;
+  job->helpers = 0;
+
+  // Only idle workers are asked to help. Busy ones would pick the task up late and find nothing left to do.
+  auto idle = self->_pool.thread_count() - std::min(self->_pool.thread_count(), self->_pool.active_count());
+  auto helpers = std::min(static_cast<size_t>(njobs - 1), idle);
+  for (auto h = 0U; h < helpers; h++) {
+    JobSlots<job_t>::retain(job);
+    self->_pool.post([job] {
+      run(*job, true);
+      JobSlots<job_t>::release(job);
+    });
+  }
+
+  run(*job, false);
+
+  {
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [job] { return job->done.load() == job->njobs; });
+  }
+  helpers_on_thread = std::max(helpers_on_thread, job->helpers.load());
+  JobSlots<job_t>::release(job);
+}
+
+void ParallelFft::run(job_t& job, bool helper) {
+  bool counted = !helper;
+  for (;;) {
+    auto idx = job.next.fetch_add(1);
+    if (idx >= job.njobs) {
+      break;
+    }
+    if (!counted) {
+      // Counted before doing any work, so the count is complete once all chunks are done
+      job.helpers++;
+      counted = true;
+    }
+    job.work(job.jobdata + job.elsize * static_cast<size_t>(idx));
+    if (job.done.fetch_add(1) + 1 == job.njobs) {
+      const std::lock_guard<std::mutex> lock(job.mutex);
+      job.finished.notify_all();
+    }
+  }
+}
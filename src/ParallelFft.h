@@ -0,0 +1,103 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <libconfig.h++>
+#include "JobSlots.h"
+
+class thread_pool;
+
+/**
+ *  Runs the large FFTs of the low subcarrier spacings on several PHY pool threads.
+ *
+ *  With 1.25 or 0.37 kHz subcarrier spacing, an MBSFN subframe holds a single huge OFDM symbol, so the
+ *  worker processing it runs one FFT of up to 80k points alone. This enables FFTW's multi-threaded
+ *  planner, and hooks FFTW's parallel loop into the PHY thread pool: the thread executing a plan
+ *  hands parts of the transform to idle workers and does the rest itself, so it never waits for a busy
+ *  worker. FFTW only splits transforms where it measured that to be faster.
+ *
+ *  FFTW's thread count for new plans is process-global. It is only raised while a Planning scope
+ *  is held, so only the MBSFN plans are made multi-threaded. The hook needs FFTW 3.3.9 or later.
+ *  With older versions, all FFTs stay single-threaded.
+ *
+ *  Helpers used per FFT are counted per thread, so the subframe latency can be reported by the number
+ *  of helpers involved.
+ */
+class ParallelFft {
+  public:
+    /**
+     *  Default constructor.
+     *
+     *  @param cfg Config singleton reference
+     *  @param pool PHY thread pool to run helpers on
+     */
+    ParallelFft(const libconfig::Config& cfg, thread_pool& pool);
+
+    /**
+     *  Default destructor.
+     */
+    virtual ~ParallelFft();
+
+    /**
+     *  Set up FFTW threading. Must be called before any FFT is planned, and before FFTW wisdom is loaded.
+     */
+    bool init();
+
+    /**
+     *  Nr of helpers that took part in FFTs executed on the calling thread since the last reset.
+     *
+     *  @param reset Reset the counter after reading
+     */
+    static unsigned helpers_used(bool reset);
+
+    /**
+     *  Scope in which FFTW plans are created multi-threaded, if parallel FFTs are enabled.
+     *
+     *  Scopes on different threads are serialized. Plans created elsewhere while a scope is held may
+     *  also become multi-threaded, which is harmless: their helpers are only taken from idle workers.
+     */
+    class Planning {
+      public:
+        Planning();
+        ~Planning();
+        Planning(const Planning&) = delete;
+        Planning& operator=(const Planning&) = delete;
+
+      private:
+        std::lock_guard<std::mutex> _lock;
+    };
+
+  private:
+    struct job_t;
+
+    static void parallel_loop(void* (*work)(char*), char* jobdata, size_t elsize, int njobs, void* data);
+    static void run(job_t& job, bool helper);
+
+    thread_pool& _pool;
+    bool _enabled = true;
+
+    std::unique_ptr<JobSlots<job_t>> _jobs;
+
+    static std::mutex _planning_mutex;
+    static int _planning_threads;
+};
@@ -19,6 +19,8 @@
 
 #include "Phy.h"
 
+#include <arpa/inet.h>
+
 #include <utility>
 #include <iomanip>
 
@@ -40,21 +42,22 @@ const uint32_t kSubframesPerFrame = 10;
 const uint32_t kMaxCellsToDiscover = 3;
 
 Phy::Phy(const libconfig::Config& cfg, get_samples_t cb, uint8_t cs_nof_prb, //NOLINT
-         int8_t override_nof_prb, uint8_t rx_channels)
+         int8_t override_nof_prb, uint8_t rx_channels, HugePageArena& arena)
       : _sample_cb(std::move(cb))
+      , _arena(arena)
       , _cs_nof_prb(cs_nof_prb)
       , _override_nof_prb(override_nof_prb)
       , _rx_channels(rx_channels) {
   cfg.lookupValue("modem.phy.pbch_repetition_r16", _has_pbch_repetition_r16);
   _buffer_max_samples = kMaxBufferSamples;
-  _mib_buffer[0] = static_cast<cf_t*>(malloc(_buffer_max_samples * sizeof(cf_t)));  // NOLINT
-  _mib_buffer[1] = static_cast<cf_t*>(malloc(_buffer_max_samples * sizeof(cf_t)));  // NOLINT
+  _mib_buffer[0] = _arena.allocate_cf(_buffer_max_samples);
+  _mib_buffer[1] = _arena.allocate_cf(_buffer_max_samples);
 }
 
 Phy::~Phy() {
   srsran_ue_sync_free(&_ue_sync);
-  free(_mib_buffer[0]);  // NOLINT
-  free(_mib_buffer[1]);  // NOLINT
+  _arena.release(_mib_buffer[0]);
+  _arena.release(_mib_buffer[1]);
 }
 
 auto Phy::synchronize_subframe() -> bool {
@@ -268,6 +271,7 @@ void Phy::set_mbsfn_config(const srsran::mcch_msg_t& mcch) {
   _mcch = mcch;
   _mch_configured = true;
 
+  const std::lock_guard<std::mutex> lock(_mch_info_mutex);
   _mch_info.clear();
   for (uint32_t i = 0; i < _mcch.nof_pmch_info; i++) {
     mch_info_t mch_info;
@@ -299,7 +303,7 @@ void Phy::set_mbsfn_config(const srsran::mcch_msg_t& mcch) {
          _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[1] << 4 | _mcch.pmch_info_list[i].mbms_session_info_list[j].tmgi.plmn_id.explicit_value.mnc[0]
          );
       mtch_info.tmgi = tmgi;
-      mtch_info.dest = _dests[i][mtch_info.lcid];
+      mtch_info.dest = _dests[i][mtch_info.lcid].dest;
       mch_info.mtchs.push_back(mtch_info);
     }
 
@@ -386,3 +390,36 @@ auto Phy::mbsfn_config_for_tti(uint32_t tti, unsigned& area)
   }
   return cfg;
 }
+
+auto Phy::mbsfn_config_matches(uint32_t tti, uint32_t other_tti) -> bool
+{
+  if (!is_mbsfn_subframe(tti) || !is_mbsfn_subframe(other_tti)) {
+    return false;
+  }
+
+  unsigned mch_idx = 0;
+  unsigned other_mch_idx = 0;
+  auto cfg = mbsfn_config_for_tti(tti, mch_idx);
+  auto other_cfg = mbsfn_config_for_tti(other_tti, other_mch_idx);
+  if (!cfg.enable || !other_cfg.enable) {
+    return false;
+  }
+  return mch_idx == other_mch_idx &&
+    cfg.is_mcch == other_cfg.is_mcch &&
+    cfg.mbsfn_mcs == other_cfg.mbsfn_mcs &&
+    cfg.mbsfn_area_id == other_cfg.mbsfn_area_id &&
+    cfg.non_mbsfn_region_length == other_cfg.non_mbsfn_region_length;
+}
+
+void Phy::set_dest_for_lcid(uint32_t mch_idx, int lcid, uint32_t addr, uint16_t port) {
+  const std::lock_guard<std::mutex> lock(_mch_info_mutex);
+  auto& dest = _dests[mch_idx][lcid];
+  if (!dest.dest.empty() && dest.addr == addr && dest.port == port) {
+    return;
+  }
+  char addr_str[INET_ADDRSTRLEN] = "";   // NOLINT
+  inet_ntop(AF_INET, &addr, addr_str, sizeof(addr_str));
+  dest.addr = addr;
+  dest.port = port;
+  dest.dest = std::string(addr_str) + ":" + std::to_string(port);
+}
@@ -23,6 +23,7 @@
 #include <cstdint>
 #include <string>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <thread>
 #include <libconfig.h++>
@@ -31,6 +32,7 @@
 #include "srsran/interfaces/rrc_interface_types.h"
 #include "srsran/common/gen_mch_tables.h"
 #include "srsran/phy/common/phy_common.h"
+#include "HugePageArena.h"
 
 constexpr unsigned int MAX_PRB = 100;
 
@@ -53,8 +55,9 @@ class Phy {
      *  @param cb  Sample recv callback
      *  @param cs_nof_prb  Nr of PRBs to use during cell search
      *  @param override_nof_prb  If set, overrides the nof PRB received in the MIB
+     *  @param arena  Memory arena for the sample buffers
      */
-    Phy(const libconfig::Config& cfg, get_samples_t cb, uint8_t cs_nof_prb, int8_t override_nof_prb, uint8_t rx_channels);
+    Phy(const libconfig::Config& cfg, get_samples_t cb, uint8_t cs_nof_prb, int8_t override_nof_prb, uint8_t rx_channels, HugePageArena& arena);
     
     /**
      *  Default destructor.
@@ -82,6 +85,9 @@ class Phy {
 
     /**
      * Get the sample data for the next subframe.
+     *
+     * Processing only starts once the whole subframe has been received. There is no
+     * symbol-by-symbol streaming into the frame processors.
      */
     bool get_next_frame(cf_t** buffer, uint32_t size);
 
@@ -97,6 +103,11 @@ class Phy {
      */
     unsigned nr_prb() { return _cell.nof_prb; }
 
+    /**
+     * Get the number of samples per antenna that get_next_frame() stores for one subframe.
+     */
+    uint32_t frame_samples() { return SRSRAN_SF_LEN_PRB(_cell.nof_prb); }
+
     /**
      * Get the current subframe TTI
      */
@@ -142,6 +153,12 @@ class Phy {
      */
     srsran_mbsfn_cfg_t mbsfn_config_for_tti(uint32_t tti, unsigned& area);
 
+    /**
+     * Returns true if both TTIs are MBSFN subframes with identical MBSFN configuration (MCH, MCS, area),
+     * i.e. they can be processed as one batch.
+     */
+    bool mbsfn_config_matches(uint32_t tti, uint32_t other_tti);
+
     /**
      * Enable MCCH decoding
      */
@@ -172,9 +189,23 @@ class Phy {
       std::vector< mtch_info_t > mtchs;
     } mch_info_t;
 
-    const std::vector< mch_info_t>& mch_info() { return _mch_info;  }
+    /**
+     *  Get a copy of the MCH/MTCH info, for display. Safe to call while it is being updated.
+     */
+    std::vector< mch_info_t > mch_info() {
+      const std::lock_guard<std::mutex> lock(_mch_info_mutex);
+      return _mch_info;
+    }
 
-    void set_dest_for_lcid(uint32_t mch_idx, int lcid, std::string dest) { _dests[mch_idx][lcid] = dest; }
+    /**
+     *  Set the destination of the IP packets received on an MTCH, for display in mch_info().
+     *  The string representation is only rebuilt if the destination changed.
+     *  Called from the network output threads.
+     *
+     *  @param addr Destination IPv4 address (network byte order)
+     *  @param port Destination UDP port (host byte order)
+     */
+    void set_dest_for_lcid(uint32_t mch_idx, int lcid, uint32_t addr, uint16_t port);
 
     enum class SubcarrierSpacing {
       df_15kHz,
@@ -214,10 +245,10 @@ class Phy {
 
     srsran::mcch_msg_t& mcch() { return _mcch; }
 
-    int _mcs = 0;
-
     get_samples_t _sample_cb;
  private:
+    HugePageArena& _arena;
+
     srsran_ue_sync_t _ue_sync = {};
     srsran_ue_cellsearch_t _cell_search = {};
     srsran_ue_mib_sync_t  _mib_sync = {};
@@ -241,7 +272,13 @@ class Phy {
 
     std::vector< mch_info_t > _mch_info;
 
-    std::map< uint32_t, std::map< int, std::string >> _dests;
+    typedef struct {
+      uint32_t addr;
+      uint16_t port;
+      std::string dest;
+    } dest_t;
+    std::map< uint32_t, std::map< int, dest_t >> _dests;
+    std::mutex _mch_info_mutex;  /**< Guards _mch_info and _dests */
 
     int8_t _override_nof_prb;
     uint8_t _rx_channels;
@@ -0,0 +1,106 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+/**
+ *  Free list of frame processors.
+ *
+ *  Every processor owns the preallocated sample buffers its subframes are received into
+ *  (srsran binds them to the FFT at init). Ownership of a processor and its buffers moves with
+ *  the subframe: the main loop acquires an idle processor and fills its buffers, the worker thread
+ *  that processes the subframe releases it back to the pool when done.
+ *
+ *  acquire() only waits if all processors are busy.
+ */
+template <class T>
+class ProcessorPool {
+  public:
+    /**
+     *  Add a processor to the pool. The pool does not take over memory ownership.
+     */
+    void add(T* processor) {
+      const std::lock_guard<std::mutex> lock(_mutex);
+      _free.reserve(++_size);
+      _free.push_back(processor);
+    }
+
+    /**
+     *  Take an idle processor off the free list, waiting for one to be released if all are busy.
+     *  The most recently released processor is returned first, as its memory is most likely still in cache.
+     */
+    T* acquire() {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _available.wait(lock, [this] { return !_free.empty(); });
+      auto processor = _free.back();
+      _free.pop_back();
+      return processor;
+    }
+
+    /**
+     *  Take an idle processor off the free list, or return nullptr if all are busy.
+     */
+    T* try_acquire() {
+      const std::lock_guard<std::mutex> lock(_mutex);
+      if (_free.empty()) {
+        return nullptr;
+      }
+      auto processor = _free.back();
+      _free.pop_back();
+      return processor;
+    }
+
+    /**
+     *  Return a processor to the free list. Can be called from any thread.
+     */
+    void release(T* processor) {
+      {
+        const std::lock_guard<std::mutex> lock(_mutex);
+        _free.push_back(processor);
+      }
+      _available.notify_one();
+    }
+
+    /**
+     *  Number of idle processors
+     */
+    size_t available() {
+      const std::lock_guard<std::mutex> lock(_mutex);
+      return _free.size();
+    }
+
+    /**
+     *  Total number of processors
+     */
+    size_t size() {
+      const std::lock_guard<std::mutex> lock(_mutex);
+      return _size;
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _available;
+    std::vector<T*> _free;
+    size_t _size = 0;
+};
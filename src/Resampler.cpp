@@ -0,0 +1,123 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "Resampler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+
+// Passband edge relative to the output Nyquist frequency
+static const double kPassband = 0.9;
+
+Resampler::Resampler(uint32_t in_rate, uint32_t out_rate, unsigned channels, uint32_t max_input, unsigned taps_per_phase)
+  : _taps(std::max(taps_per_phase, 2U))
+  , _max_input(max_input)
+{
+  auto gcd = std::gcd(in_rate, out_rate);
+  _interpolation = out_rate / gcd;
+  _decimation = in_rate / gcd;
+  if (!valid()) {
+    return;
+  }
+
+  // Windowed sinc prototype at the upsampled rate, cut off below the lower of the two Nyquist frequencies
+  auto len = _interpolation * _taps;
+  double cutoff = kPassband * 0.5 / std::max(_interpolation, _decimation);
+  std::vector<double> prototype(len);
+  double center = (len - 1) / 2.0;
+  for (auto i = 0U; i < len; i++) {
+    double t = i - center;
+    double sinc = t == 0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * t) / (M_PI * t);
+    double window = 0.42 - 0.5 * std::cos(2.0 * M_PI * i / (len - 1)) + 0.08 * std::cos(4.0 * M_PI * i / (len - 1));
+    prototype[i] = sinc * window * _interpolation;
+  }
+
+  // Phase p holds h[p], h[p + L], ..., reversed, so it can be applied to the input in ascending order
+  _filter.resize(len);
+  for (auto p = 0U; p < _interpolation; p++) {
+    for (auto k = 0U; k < _taps; k++) {
+      _filter[p * _taps + (_taps - 1 - k)] = static_cast<float>(prototype[p + k * _interpolation]);
+    }
+  }
+
+  _history.resize(channels);
+  for (auto& h : _history) {
+    h.resize(_taps - 1 + _max_input);
+  }
+  reset();
+}
+
+auto Resampler::taps_per_phase_for(uint32_t in_rate, uint32_t out_rate, unsigned taps_per_slow_sample) -> unsigned {
+  auto gcd = std::gcd(in_rate, out_rate);
+  auto interpolation = static_cast<uint64_t>(out_rate / gcd);
+  auto decimation = static_cast<uint64_t>(in_rate / gcd);
+  // The prototype has L * taps_per_phase taps at L times the input rate
+  return static_cast<unsigned>((taps_per_slow_sample * std::max(interpolation, decimation) + interpolation - 1) / interpolation);
+}
+
+void Resampler::reset() {
+  // Only the history part matters, the rest is overwritten by the next block
+  for (auto& h : _history) {
+    std::fill(h.begin(), h.begin() + _taps - 1, cf_t{});
+  }
+  _phase = 0;
+  _offset = 0;
+}
+
+auto Resampler::process(const std::vector<void*>& in, uint32_t nin, const std::vector<void*>& out) -> uint32_t {
+  auto started = std::chrono::steady_clock::now();
+  nin = std::min(nin, _max_input);
+
+  uint32_t produced = 0;
+  uint32_t phase = 0;
+  uint32_t offset = 0;
+  for (auto ch = 0U; ch < _history.size(); ch++) {
+    auto history = _history[ch].data();
+    srsran_vec_cf_copy(history + _taps - 1, static_cast<cf_t*>(in[ch]), nin);
+
+    // All channels share the same output positions
+    auto dst = static_cast<cf_t*>(out[ch]);
+    produced = 0;
+    phase = _phase;
+    offset = _offset;
+    while (offset < nin) {
+      dst[produced++] = srsran_vec_dot_prod_cfc(history + offset, &_filter[phase * _taps], _taps);
+      phase += _decimation;
+      offset += phase / _interpolation;
+      phase %= _interpolation;
+    }
+
+    // Keep the tail as history for the next block
+    std::copy(history + nin, history + nin + _taps - 1, history);
+  }
+  _phase = phase;
+  _offset = offset - nin;
+
+  _busy_ns += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+  _samples += nin;
+  return produced;
+}
+
+auto Resampler::us_per_msps(bool reset) -> double {
+  uint64_t busy_ns = reset ? _busy_ns.exchange(0) : _busy_ns.load();
+  uint64_t samples = reset ? _samples.exchange(0) : _samples.load();
+  return samples > 0 ? static_cast<double>(busy_ns) / static_cast<double>(samples) * 1000.0 : 0.0;
+}
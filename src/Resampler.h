@@ -0,0 +1,122 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "srsran/srsran.h"
+
+/**
+ *  Rational polyphase resampler for converting the SDR's native sample rate to the LTE sample rate.
+ *
+ *  The rate ratio out/in is reduced to L/M. A windowed-sinc lowpass of L * taps_per_phase taps is split
+ *  into L phases; every output sample is the dot product of one phase with the latest taps_per_phase
+ *  input samples, computed with srsran's SIMD vector kernels (AVX2 / NEON, depending on the build).
+ *  Filter state is kept across calls, so the input can be fed in arbitrary block sizes.
+ */
+class Resampler {
+  public:
+    /**
+     *  Largest supported interpolation factor L
+     */
+    static const uint32_t kMaxPhases = 1024;
+
+    /**
+     *  Default constructor.
+     *
+     *  @param in_rate Input sample rate in Hz
+     *  @param out_rate Output sample rate in Hz
+     *  @param channels Nr of channels
+     *  @param max_input Largest nr of input samples per call to process()
+     *  @param taps_per_phase Filter length per phase
+     */
+    Resampler(uint32_t in_rate, uint32_t out_rate, unsigned channels, uint32_t max_input, unsigned taps_per_phase);
+
+    /**
+     *  Filter length per phase for a lowpass that spans taps_per_slow_sample taps per sample period of the
+     *  lower of the two rates. This keeps the transition band the same fraction of the output bandwidth
+     *  for every rate ratio, e.g. 4 times the taps per phase for 1:4 decimation than for 1:1.
+     *
+     *  @param in_rate Input sample rate in Hz
+     *  @param out_rate Output sample rate in Hz
+     *  @param taps_per_slow_sample Filter length per sample period of the lower rate
+     */
+    static unsigned taps_per_phase_for(uint32_t in_rate, uint32_t out_rate, unsigned taps_per_slow_sample);
+
+    /**
+     *  Returns false if the rate ratio can not be handled (L > kMaxPhases)
+     */
+    bool valid() const { return _interpolation <= kMaxPhases; }
+
+    uint32_t interpolation() const { return _interpolation; }
+    uint32_t decimation() const { return _decimation; }
+
+    /**
+     *  Upper bound for the nr of samples process() produces from nin input samples
+     */
+    uint32_t max_output(uint32_t nin) const {
+      return static_cast<uint32_t>((static_cast<uint64_t>(nin) * _interpolation + _decimation - 1) / _decimation) + 1;
+    }
+
+    /**
+     *  Largest nr of input samples for which process() produces no more than out_space samples
+     */
+    uint32_t max_input_for(uint32_t out_space) const {
+      return out_space < 2 ? 0 : static_cast<uint32_t>(static_cast<uint64_t>(out_space - 2) * _decimation / _interpolation);
+    }
+
+    /**
+     *  Resample a block of samples.
+     *
+     *  @param in Input buffers, one per channel
+     *  @param nin Nr of input samples per channel, at most max_input
+     *  @param out Output buffers, one per channel, each with room for max_output(nin) samples
+     *  @return Nr of samples written to each output buffer
+     */
+    uint32_t process(const std::vector<void*>& in, uint32_t nin, const std::vector<void*>& out);
+
+    /**
+     *  Clear the filter state, e.g. before feeding a block that does not continue the previous one
+     */
+    void reset();
+
+    /**
+     *  CPU time spent in process() per million input samples, in microseconds, since the last reset.
+     *
+     *  @param reset Reset the statistics after reading
+     */
+    double us_per_msps(bool reset);
+
+  private:
+    uint32_t _interpolation;
+    uint32_t _decimation;
+    unsigned _taps;
+    uint32_t _max_input;
+
+    std::vector<float> _filter;                 /**< L phases of _taps coefficients, each in reverse order */
+    std::vector<std::vector<cf_t>> _history;    /**< Per channel: last _taps - 1 input samples, then the current block */
+
+    uint32_t _phase = 0;
+    uint32_t _offset = 0;
+
+    std::atomic<uint64_t> _busy_ns = {0};
+    std::atomic<uint64_t> _samples = {0};
+};
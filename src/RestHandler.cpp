@@ -57,6 +57,12 @@ RestHandler::RestHandler(const libconfig::Config& cfg, const std::string& url,
         });
   }
 
+  double snapshot_rate_hz = 10;
+  cfg.lookupValue("modem.restful_api.snapshots.max_rate_hz", snapshot_rate_hz);
+  unsigned snapshot_timeout_s = 10;
+  cfg.lookupValue("modem.restful_api.snapshots.subscription_timeout_s", snapshot_timeout_s);
+  SampleSnapshot::configure(snapshot_rate_hz, snapshot_timeout_s);
+
   cfg.lookupValue("modem.restful_api.api_key.enabled", _require_bearer_token);
   if (_require_bearer_token) {
     _api_key = "106cd60-76c8-4c37-944c-df21aa690c1e";
@@ -123,7 +129,7 @@ void RestHandler::get(http_request message) {
       sdr["buffer_level"] = value(_sdr.get_buffer_level());
       message.reply(status_codes::OK, sdr);
     } else if (paths[0] == "ce_values") {
-      auto cestream = Concurrency::streams::bytestream::open_istream(_ce_values);
+      auto cestream = Concurrency::streams::bytestream::open_istream(_ce_values.GetData());
       message.reply(status_codes::OK, cestream);
     } else if (paths[0] == "pdsch_status") {
       value sdr = value::object();
@@ -178,6 +184,42 @@ void RestHandler::get(http_request message) {
       int idx = std::stoi(paths[1]);
       auto cestream = Concurrency::streams::bytestream::open_istream(_mch[idx].GetData());
       message.reply(status_codes::OK, cestream);
+    } else if (paths[0] == "mbsfn_latency" || paths[0] == "mbsfn_rx_latency") {
+      std::vector<value> lat;
+      auto summary = (paths[0] == "mbsfn_latency" ? _mbsfn_latency : _mbsfn_rx_latency).summary(false);
+      std::for_each(std::begin(summary), std::end(summary), [&lat](LatencyStats::summary_t const& s) {
+          value l;
+          l["mcs"] = value(s.key);
+          l["count"] = value(static_cast<uint64_t>(s.count));
+          l["p50_us"] = value(s.p50_us);
+          l["p99_us"] = value(s.p99_us);
+          l["max_us"] = value(s.max_us);
+          lat.push_back(l);
+      });
+      message.reply(status_codes::OK, value::array(lat));
+    } else if (paths[0] == "mch_reorder") {
+      value reorder;
+      reorder["delivered"] = value(static_cast<uint64_t>(_mch_reorder.delivered));
+      reorder["skipped"] = value(static_cast<uint64_t>(_mch_reorder.skipped));
+      reorder["late"] = value(static_cast<uint64_t>(_mch_reorder.late));
+      reorder["overflows"] = value(static_cast<uint64_t>(_mch_reorder.overflows));
+      reorder["contended"] = value(static_cast<uint64_t>(_mch_reorder.contended));
+      reorder["depth"] = value(static_cast<uint32_t>(_mch_reorder.depth));
+      reorder["max_depth"] = value(static_cast<uint32_t>(_mch_reorder.max_depth));
+      message.reply(status_codes::OK, reorder);
+    } else if (paths[0] == "gw_status") {
+      value gw;
+      gw["packets"] = value(static_cast<uint64_t>(_gw.packets));
+      gw["drops"] = value(static_cast<uint64_t>(_gw.drops));
+      gw["write_errors"] = value(static_cast<uint64_t>(_gw.write_errors));
+      gw["depth"] = value(static_cast<uint32_t>(_gw.depth));
+      gw["max_depth"] = value(static_cast<uint32_t>(_gw.max_depth));
+      std::vector<value> batches;
+      for (auto& b : _gw.batches) {
+        batches.push_back(value(static_cast<uint64_t>(b)));
+      }
+      gw["batch_histogram"] = value::array(batches);
+      message.reply(status_codes::OK, gw);
     } else if (paths[0] == "log") {
       std::string logfile = "/var/log/syslog";
 
@@ -18,6 +18,8 @@
 //
 
 #pragma once
+#include <array>
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -26,6 +28,8 @@
 
 #include "SdrReader.h"
 #include "Phy.h"
+#include "LatencyStats.h"
+#include "SampleSnapshot.h"
 
 #include "cpprest/json.h"
 #include "cpprest/http_listener.h"
@@ -65,32 +69,21 @@ class RestHandler {
     virtual ~RestHandler();
 
     /**
-     *  RX Info pertaining to an SCH (MCCH/MCH or PDSCH)
+     *  RX Info pertaining to an SCH (MCCH/MCH or PDSCH), with a snapshot of its constellation diagram
      */
-    class ChannelInfo {
+    class ChannelInfo : public SampleSnapshot {
       public:
-        void SetData( std::vector<uint8_t> data) {
-          std::lock_guard<std::mutex> lock(_data_mutex);
-          _data = data;
-        };
-        std::vector<uint8_t> GetData() { 
-          std::lock_guard<std::mutex> lock(_data_mutex);
-          return _data; 
-        };
         bool present = false;
         int mcs = 0;
         double ber;
         unsigned total = 1;
         unsigned errors = 0;
-      private:
-        std::vector<uint8_t> _data = {};
-        std::mutex _data_mutex;
     };
 
     /**
      *  Time domain subcarrier CE values
      */
-    std::vector<uint8_t> _ce_values = {};
+    SampleSnapshot _ce_values;
 
     /**
      *  RX info for PDSCH
@@ -107,6 +100,67 @@ class RestHandler {
      */
     std::map<uint32_t, ChannelInfo> _mch;
 
+    /**
+     *  MBSFN subframe processing latency (FFT to decoded TB), by MCS
+     */
+    LatencyStats _mbsfn_latency;
+
+    /**
+     *  Time from the reception of the last sample of an MBSFN subframe to its decoded TB, by MCS.
+     *  Includes the time the samples spent in the SDR ring buffer.
+     */
+    LatencyStats _mbsfn_rx_latency{500};
+
+    /**
+     *  MBSFN FFT and channel estimation time, by nr of threads that helped with the FFT
+     */
+    LatencyStats _mbsfn_fft_latency;
+
+    /**
+     *  Counters of the stage that passes MCH PDUs to RLC in TTI order
+     */
+    struct {
+      std::atomic<uint64_t> delivered = {0};  /**< Subframes delivered in order */
+      std::atomic<uint64_t> skipped = {0};    /**< Subframes given up on after the maximum wait */
+      std::atomic<uint64_t> late = {0};       /**< Subframes dropped because they completed after being skipped */
+      std::atomic<uint64_t> overflows = {0};  /**< Subframes dropped because the reorder ring was full */
+      std::atomic<uint64_t> contended = {0};  /**< Deliveries left to another thread already delivering on the same lane */
+      std::atomic<uint32_t> depth = {0};      /**< Subframes currently waiting for delivery */
+      std::atomic<uint32_t> max_depth = {0};  /**< Highest nr of subframes waiting for delivery */
+    } _mch_reorder;
+
+    /**
+     *  Time a processor spends handing a subframe to RLC, including the delivery of subframes
+     *  that were waiting for it, by reorder lane (0: MCCH, or all MCHs if not sharded, n: MCH n-1)
+     */
+    LatencyStats _mch_delivery_latency;
+
+    /**
+     *  Counters of the GW output thread
+     */
+    struct gw_stats_t {
+      /**
+       *  Nr of batch size buckets: 1, 2-3, 4-7, ..., 256 and more packets written per wakeup
+       */
+      static const unsigned kBatchBuckets = 10;
+
+      std::atomic<uint64_t> packets = {0};       /**< Packets written to the TUN interface, or sent on the UDP sockets */
+      std::atomic<uint64_t> drops = {0};         /**< Packets dropped because the output queue was full */
+      std::atomic<uint64_t> write_errors = {0};  /**< Failed writes to the TUN interface, or failed UDP sends */
+      std::atomic<uint32_t> depth = {0};         /**< Packets queued after the last batch */
+      std::atomic<uint32_t> max_depth = {0};     /**< Highest nr of queued packets */
+      std::array<std::atomic<uint64_t>, kBatchBuckets> batches = {};  /**< Packets written per wakeup */
+
+      void add_batch(unsigned size) {
+        unsigned bucket = 0;
+        while (size > 1 && bucket < kBatchBuckets - 1) {
+          size >>= 1U;
+          bucket++;
+        }
+        batches[bucket].fetch_add(1, std::memory_order_relaxed);
+      }
+    } _gw;
+
     /**
      *  Current CINR value
      */
@@ -43,9 +43,11 @@ void Rrc::write_pdu_mch(uint32_t /*lcid*/, srsran::unique_byte_buffer_t pdu) {
     spdlog::error("Failed to unpack MCCH message");
     return;
   }
-  asn1::json_writer json_writer;
-  msg.to_json(json_writer);
-  spdlog::debug("BCCH-DLSCH message content:\n{}", json_writer.to_string());
+  if (spdlog::get_level() <= spdlog::level::debug) {
+    asn1::json_writer json_writer;
+    msg.to_json(json_writer);
+    spdlog::debug("BCCH-DLSCH message content:\n{}", json_writer.to_string());
+  }
 
   srsran::mcch_msg_t mcch = srsran::make_mcch_msg(msg);
 
@@ -79,15 +81,20 @@ void Rrc::write_pdu_bcch_dlsch(srsran::unique_byte_buffer_t pdu) {
     asn1::cbit_ref    dlsch_bref(pdu->msg, pdu->N_bytes);
     dlsch_msg1.unpack(dlsch_bref);
 
-    asn1::json_writer json_writer;
-    dlsch_msg1.to_json(json_writer);
-    spdlog::debug("BCCH-DLSCH message content:\n{}", json_writer.to_string());
+    if (spdlog::get_level() <= spdlog::level::debug) {
+      asn1::json_writer json_writer;
+      dlsch_msg1.to_json(json_writer);
+      spdlog::debug("BCCH-DLSCH message content:\n{}", json_writer.to_string());
+    }
     return;
   }
 
-  asn1::json_writer json_writer;
-  dlsch_msg.to_json(json_writer);
-  spdlog::debug("BCCH-DLSCH MBMS message content:\n{}", json_writer.to_string());
+  // Only rendered when logged, as building the JSON allocates for every SIB
+  if (spdlog::get_level() <= spdlog::level::debug) {
+    asn1::json_writer json_writer;
+    dlsch_msg.to_json(json_writer);
+    spdlog::debug("BCCH-DLSCH MBMS message content:\n{}", json_writer.to_string());
+  }
 
   if (dlsch_msg.msg.c1().type() == bcch_dl_sch_msg_type_mbms_r14_c::c1_c_::types::sib_type1_mbms_r14) {
     spdlog::debug("Processing SIB1-MBMS (1/1)");
@@ -0,0 +1,66 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include "SampleSnapshot.h"
+
+#include <chrono>
+
+std::atomic<int64_t> SampleSnapshot::_interval_ns = {100000000};
+std::atomic<int64_t> SampleSnapshot::_subscription_timeout_ns = {10000000000};
+
+void SampleSnapshot::configure(double max_rate_hz, unsigned subscription_timeout_s) {
+  _interval_ns = max_rate_hz > 0 ? static_cast<int64_t>(1e9 / max_rate_hz) : 0;
+  _subscription_timeout_ns = static_cast<int64_t>(subscription_timeout_s) * 1000000000;
+}
+
+auto SampleSnapshot::now_ns() -> int64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+auto SampleSnapshot::WantsData() -> bool {
+  auto now = now_ns();
+  if (now - _last_request_ns.load(std::memory_order_relaxed) > _subscription_timeout_ns.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  auto last = _last_snapshot_ns.load(std::memory_order_relaxed);
+  if (now - last < _interval_ns.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  // Several processors may ask at the same time. Only one of them gets to take the snapshot.
+  return _last_snapshot_ns.compare_exchange_strong(last, now, std::memory_order_relaxed);
+}
+
+void SampleSnapshot::SetData(const uint8_t* data, size_t size) {
+  const std::unique_lock<std::mutex> write_lock(_write_mutex, std::try_to_lock);
+  if (!write_lock.owns_lock()) {
+    return;
+  }
+  _buffers[_back].assign(data, data + size);
+  _back = _middle.exchange(_back | kFresh, std::memory_order_acq_rel) & ~kFresh;
+}
+
+auto SampleSnapshot::GetData() -> std::vector<uint8_t> {
+  _last_request_ns = now_ns();
+  const std::lock_guard<std::mutex> lock(_read_mutex);
+  if ((_middle.load(std::memory_order_relaxed) & kFresh) != 0) {
+    _front = _middle.exchange(_front, std::memory_order_acq_rel) & ~kFresh;
+  }
+  return _buffers[_front];
+}
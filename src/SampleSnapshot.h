@@ -0,0 +1,86 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ *  Binary data for display in the web UI (constellation diagram, CE values).
+ *
+ *  Copying symbols out of the PHY for every subframe is wasted effort when nobody is looking.
+ *  Frame processors therefore ask WantsData() first, which is only true if a REST client requested
+ *  this data recently, and at most at the configured snapshot rate.
+ *
+ *  Snapshots are triple buffered: the PHY writes into its back buffer and publishes it by swapping it
+ *  with the middle buffer, readers swap the middle buffer with their front buffer if it holds a newer snapshot.
+ *  The swaps are atomic index exchanges, so readers never block the PHY, however long they take to copy.
+ */
+class SampleSnapshot {
+  public:
+    /**
+     *  Set the snapshot rate and subscription timeout for all snapshots.
+     *
+     *  @param max_rate_hz Maximum number of snapshots per second
+     *  @param subscription_timeout_s Time after the last request before snapshots are no longer taken
+     */
+    static void configure(double max_rate_hz, unsigned subscription_timeout_s);
+
+    /**
+     *  Returns true if a snapshot should be taken now. A true result reserves the snapshot slot,
+     *  and the caller is expected to call SetData().
+     */
+    bool WantsData();
+
+    /**
+     *  Copy data into the back buffer and publish it. Once the buffers have grown to their working
+     *  size, this does not allocate. If another processor is publishing at the same time, the data is dropped.
+     */
+    void SetData(const uint8_t* data, size_t size);
+
+    /**
+     *  Get the latest snapshot. Subscribes the caller to snapshots for the subscription timeout.
+     */
+    std::vector<uint8_t> GetData();
+
+  private:
+    static int64_t now_ns();
+
+    static std::atomic<int64_t> _interval_ns;
+    static std::atomic<int64_t> _subscription_timeout_ns;
+
+    std::atomic<int64_t> _last_request_ns = {INT64_MIN / 2};
+    std::atomic<int64_t> _last_snapshot_ns = {INT64_MIN / 2};
+
+    /**
+     *  Set in _middle if the middle buffer holds a snapshot readers have not taken yet
+     */
+    static const unsigned kFresh = 4;
+
+    std::vector<uint8_t> _buffers[3];  // NOLINT
+    unsigned _back = 0;                /**< Only used by writers */
+    unsigned _front = 1;               /**< Only used by readers */
+    std::atomic<unsigned> _middle = {2};
+    std::mutex _write_mutex;           /**< Serializes writers, which never wait for it */
+    std::mutex _read_mutex;            /**< Serializes readers */
+};
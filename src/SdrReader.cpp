@@ -23,6 +23,7 @@
 
 #include <boost/algorithm/string/join.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 
@@ -95,12 +96,23 @@ auto SdrReader::init(const std::string& device_args, const char* sample_file,
   }
 
   _cfg.lookupValue("modem.sdr.ringbuffer_size_ms", _buffer_ms);
+  _fill_ms = _buffer_ms / 2;
+  _cfg.lookupValue("modem.sdr.ringbuffer_fill_ms", _fill_ms);
+  _fill_ms = std::min(_fill_ms, _buffer_ms / 2);
+
+  _cfg.lookupValue("modem.sdr.resampler.enabled", _resampling_enabled);
+  _cfg.lookupValue("modem.sdr.resampler.sdr_sample_rate_hz", _native_sample_rate);
+  _cfg.lookupValue("modem.sdr.resampler.taps_per_sample", _resampler_taps_per_sample);
+  if (_reading_from_file || _native_sample_rate == 0) {
+    _resampling_enabled = false;
+  }
   return true;
 }
 
 void SdrReader::init_buffer() {
   auto buffer_size = (unsigned int)ceil(_sampleRate/1000.0 * _buffer_ms);
   _buffer = std::make_unique<MultichannelRingbuffer>(sizeof(cf_t) * buffer_size, _rx_channels);
+  _read_buffers.resize(_rx_channels, nullptr);
   _buffer_ready = true;
 }
 
@@ -187,14 +199,22 @@ auto SdrReader::tune(uint32_t frequency, uint32_t sample_rate,
     set_gain(_use_agc, gain, ch);
     set_frequency(frequency, ch);
     set_filter_bw(bandwidth, ch);
-    set_sample_rate(sample_rate, ch);
+    set_sample_rate(_resampling_enabled ? _native_sample_rate : sample_rate, ch);
   }
 
   _frequency = sdr->getFrequency( SOAPY_SDR_RX, 0);
   _filterBw = static_cast<unsigned>(sdr->getBandwidth( SOAPY_SDR_RX, 0));
-  _sampleRate = sdr->getSampleRate( SOAPY_SDR_RX, 0);
+  _sdrSampleRate = sdr->getSampleRate( SOAPY_SDR_RX, 0);
+  _sampleRate = _sdrSampleRate;
   _gain = sdr->getGain( SOAPY_SDR_RX, 0);
 
+  if (_resampling_enabled) {
+    if (!setup_resampler(sample_rate)) {
+      return false;
+    }
+    _sampleRate = sample_rate;
+  }
+
   spdlog::info("SDR tuned to {} MHz, filter bandwidth {} MHz, sample rate {}, gain {}, antenna path {}",
       _frequency/1000000.0, _filterBw/1000000.0, _sampleRate/1000000.0, _gain, _antenna);
 
@@ -208,6 +228,33 @@ auto SdrReader::tune(uint32_t frequency, uint32_t sample_rate,
   return true;
 }
 
+auto SdrReader::setup_resampler(uint32_t sample_rate) -> bool {
+  auto sdr_rate = static_cast<uint32_t>(std::lround(_sdrSampleRate));
+  if (sdr_rate == sample_rate) {
+    _resampler.reset();
+    return true;
+  }
+
+  auto max_input = static_cast<uint32_t>(ceil(_sdrSampleRate / 1000.0));
+  auto taps = Resampler::taps_per_phase_for(sdr_rate, sample_rate, _resampler_taps_per_sample);
+  _resampler = std::make_unique<Resampler>(sdr_rate, sample_rate, _rx_channels, max_input, taps);
+  if (!_resampler->valid()) {
+    spdlog::error("Cannot resample from {} to {} Msps, the rate ratio is too complex", sdr_rate / 1000000.0, sample_rate / 1000000.0);
+    _resampler.reset();
+    return false;
+  }
+
+  _native_buffers.resize(_rx_channels);
+  _native_heads.resize(_rx_channels);
+  for (auto ch = 0U; ch < _rx_channels; ch++) {
+    _native_buffers[ch].resize(max_input);
+    _native_heads[ch] = _native_buffers[ch].data();
+  }
+  spdlog::info("Resampling from {} Msps (SDR) to {} Msps (PHY), L = {}, M = {}, {} taps per phase",
+      sdr_rate / 1000000.0, sample_rate / 1000000.0, _resampler->interpolation(), _resampler->decimation(), taps);
+  return true;
+}
+
 void SdrReader::start() {
   spdlog::debug("Starting SdrReader");
   if (_sdr != nullptr) {
@@ -258,15 +305,16 @@ void SdrReader::stop() {
 
 void SdrReader::read() {
   while (_running) {
-    int toRead = ceil(_sampleRate / 1000.0);
+    int toRead = ceil((_resampler ? _sdrSampleRate : _sampleRate) / 1000.0);
     //int toRead = 254;
-    if (_buffer->free_size() < toRead * sizeof(cf_t)) {
+    size_t required = _resampler ? _resampler->max_output(toRead) : toRead;
+    if (_buffer->free_size() < required * sizeof(cf_t)) {
       spdlog::debug("ringbuffer overflow");
       std::this_thread::sleep_for(std::chrono::microseconds(1000));
     } else {
       int read = 0;
       size_t writeable = 0;
-      auto buffers = _buffer->write_head(&writeable);
+      auto& buffers = _buffer->write_head(&writeable);
       int writeable_samples = (int)floor(writeable / sizeof(cf_t));
 
       if (_reading_from_file) {
@@ -292,8 +340,16 @@ void SdrReader::read() {
         int flags = 0;
         long long time_ns = 0;
 
-        read = sdr->readStream( (SoapySDR::Stream*)_stream, buffers.data(), std::min(writeable_samples, toRead), flags, time_ns);
-
+        if (_resampler) {
+          // Read at the SDR's rate into the native buffers, and resample into the ring
+          int max_input = std::min(toRead, static_cast<int>(_resampler->max_input_for(writeable_samples)));
+          read = sdr->readStream( (SoapySDR::Stream*)_stream, _native_heads.data(), max_input, flags, time_ns);
+          if (read > 0) {
+            read = static_cast<int>(_resampler->process(_native_heads, read, buffers));
+          }
+        } else {
+          read = sdr->readStream( (SoapySDR::Stream*)_stream, buffers.data(), std::min(writeable_samples, toRead), flags, time_ns);
+        }
 
         if (read> 0) {
           if (_writing_to_file && _write_samples) {
@@ -321,25 +377,26 @@ auto SdrReader::get_samples(cf_t* data[SRSRAN_MAX_CHANNELS], uint32_t nsamples,
   auto required_time_us = static_cast<int64_t>((1000000.0/_sampleRate) * nsamples);
   size_t cnt = nsamples * sizeof(cf_t);
 
-  if (_high_watermark_reached && static_cast<double>(_buffer->used_size()) < (_sampleRate / 1000.0) * 10 * sizeof(cf_t)) {
+  // The fill level is what every sample waits in the buffer before being processed. It must absorb the jitter of
+  // the SDR driver and the main loop, but adds directly to the latency from reception to decoded data.
+  if (_high_watermark_reached && static_cast<double>(_buffer->used_size()) < (_sampleRate / 1000.0) * std::min(10.0, _fill_ms / 4.0) * sizeof(cf_t)) {
     _high_watermark_reached = false;
   }
 
   if (!_high_watermark_reached) {
-    while (static_cast<double>(_buffer->used_size()) < (_sampleRate / 1000.0) * (_buffer_ms / 2.0) * sizeof(cf_t)) {
+    while (static_cast<double>(_buffer->used_size()) < (_sampleRate / 1000.0) * _fill_ms * sizeof(cf_t)) {
       std::this_thread::sleep_for(std::chrono::microseconds(500));
     }
-    spdlog::debug("Filled ringbuffer to half capacity");
+    spdlog::debug("Filled ringbuffer to {} ms", _fill_ms);
     _high_watermark_reached = true;
   }
 
-  std::vector<char*> buffers(_rx_channels);
   for (auto ch = 0UL; ch < _rx_channels; ch++) {
-    buffers[ch] = (char*)data[ch];
+    _read_buffers[ch] = (char*)data[ch];
   }
-  _buffer->read(buffers, cnt);
+  _buffer->read(_read_buffers, cnt);
 
-  if (static_cast<double>(_buffer->used_size()) < (_sampleRate / 1000.0) * (_buffer_ms / 4.0) * sizeof(cf_t)) {
+  if (static_cast<double>(_buffer->used_size()) < (_sampleRate / 1000.0) * (_fill_ms / 2.0) * sizeof(cf_t)) {
     required_time_us += 500;
   } else {
     required_time_us -= 500;
@@ -366,6 +423,13 @@ auto SdrReader::get_samples(cf_t* data[SRSRAN_MAX_CHANNELS], uint32_t nsamples,
   return 0;
 }
 
+auto SdrReader::get_buffered_us() -> int64_t {
+  if (!_buffer_ready) {
+    return 0;
+  }
+  return static_cast<int64_t>(static_cast<double>(_buffer->used_size() / sizeof(cf_t)) / _sampleRate * 1000000.0);
+}
+
 auto SdrReader::get_buffer_level() -> double
 { 
   if (!_buffer_ready) { 
@@ -27,6 +27,7 @@
 #include <libconfig.h++>
 #include "srsran/srsran.h"
 #include "MultichannelRingbuffer.h"
+#include "Resampler.h"
 
 /**
  *  Interface to the SDR stick.
@@ -91,10 +92,22 @@ public:
     int get_samples(cf_t* data[SRSRAN_MAX_CHANNELS], uint32_t nsamples, srsran_timestamp_t* rx_time);
 
     /**
-     * Get current sample rate
+     * Get current sample rate (as delivered to the PHY)
      */
     double get_sample_rate() { return _sampleRate; }
 
+    /**
+     * Get the sample rate the SDR runs at. Differs from get_sample_rate() if the resampler is in use.
+     */
+    double get_sdr_sample_rate() { return _resampler ? _sdrSampleRate : _sampleRate; }
+
+    /**
+     * CPU time spent resampling per million SDR samples in microseconds, 0 if the resampler is not in use.
+     *
+     * @param reset Reset the statistics after reading
+     */
+    double resampler_us_per_msps(bool reset) { return _resampler ? _resampler->us_per_msps(reset) : 0.0; }
+
     /**
      * Get current center frequency
      */
@@ -115,6 +128,12 @@ public:
      */
     double get_buffer_level();
 
+    /**
+     * Get the duration of the samples currently held in the ringbuffer, in microseconds.
+     * This is how long ago the next sample to be read was received.
+     */
+    int64_t get_buffered_us();
+
     /**
      * Get current antenna port
      */
@@ -146,6 +165,7 @@ public:
     bool set_filter_bw(uint32_t bandwidth, uint8_t idx);
     bool set_antenna(const std::string& antenna, uint8_t idx);
     bool set_frequency(uint32_t frequency, uint8_t idx);
+    bool setup_resampler(uint32_t sample_rate);
     void read();
     void* _sdr = nullptr;
     void* _stream = nullptr;
@@ -154,11 +174,20 @@ public:
     unsigned _rx_channels = 1;
 
     std::unique_ptr<MultichannelRingbuffer> _buffer;
+    std::vector<char*> _read_buffers;
+
+    bool _resampling_enabled = false;
+    uint32_t _native_sample_rate = 0;
+    unsigned _resampler_taps_per_sample = 24;  /**< Filter length per sample period of the lower rate, see Resampler::taps_per_phase_for() */
+    std::unique_ptr<Resampler> _resampler;
+    std::vector<std::vector<cf_t>> _native_buffers;
+    std::vector<void*> _native_heads;
 
     std::thread _readerThread;
     bool _running;
 
     double _sampleRate;
+    double _sdrSampleRate = 0;
     double _frequency;
     unsigned _filterBw;
     double _gain;
@@ -176,6 +205,7 @@ public:
     int _sleep_adjustment = 0;
 
     unsigned _buffer_ms = 200;
+    unsigned _fill_ms = 100;
     bool _buffer_ready = false;
     bool _reading_from_file = false;
     bool _writing_to_file = false;
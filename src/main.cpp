@@ -30,15 +30,30 @@
 
 #include <argp.h>
 
+#include <chrono>
 #include <cstdlib>
+#include <future>
 #include <libconfig.h++>
+#include <memory>
 
+#include "AllocationTracker.h"
+#include "AntennaSelector.h"
 #include "CasFrameProcessor.h"
+#include "CellContext.h"
+#include "ChannelStateStore.h"
+#include "CodeblockDecoder.h"
+#include "FftBenchmark.h"
+#include "GwBenchmark.h"
+#include "FftWisdom.h"
 #include "Gw.h"
+#include "HugePageArena.h"
 #include "SdrReader.h"
 #include "MbsfnFrameProcessor.h"
+#include "MchReorderBuffer.h"
 #include "MeasurementFileWriter.h"
+#include "ParallelFft.h"
 #include "Phy.h"
+#include "ProcessorPool.h"
 #include "RestHandler.h"
 #include "Rrc.h"
 #include "Version.h"
@@ -90,6 +105,19 @@ static struct argp_option options[] = {  // NOLINT
      "Override the number of PRB received in the MIB", 0},
     {"sdr_devices", 'd', nullptr, 0,
      "Prints a list of all available SDR devices", 0},
+    {"fft-benchmark", 'B', nullptr, 0,
+     "Benchmark MBSFN OFDM demodulation for all subcarrier spacings and "
+     "bandwidths, then exit",
+     0},
+    {"gw-benchmark", 'G', "# MTCHs", 0,
+     "Benchmark the gateway output with the given number of concurrent "
+     "MTCHs, then exit",
+     0},
+    {"allocation-test", 'A', "SECONDS", 0,
+     "Check that steady-state processing does not allocate for the given "
+     "time after the first measurement interval, then exit with 0 if it "
+     "did not. Needs a build with ENABLE_ALLOCATION_TRACKING",
+     0},
     {nullptr, 0, nullptr, 0, nullptr, 0}};
 
 /**
@@ -105,6 +133,9 @@ struct arguments {
   const char
       *write_sample_file = {};   /**< file path of the created sample file. */
   bool list_sdr_devices = false;
+  bool fft_benchmark = false;    /**< run the FFT benchmark and exit */
+  unsigned gw_benchmark = 0;     /**< run the gateway benchmark with this many MTCHs and exit */
+  unsigned allocation_test = 0;  /**< check for steady-state heap allocations for this many seconds and exit */
 };
 
 /**
@@ -139,6 +170,15 @@ static auto parse_opt(int key, char *arg, struct argp_state *state) -> error_t {
     case 'd':
       arguments->list_sdr_devices = true;
       break;
+    case 'B':
+      arguments->fft_benchmark = true;
+      break;
+    case 'G':
+      arguments->gw_benchmark = static_cast<unsigned>(strtoul(arg, nullptr, 10));
+      break;
+    case 'A':
+      arguments->allocation_test = static_cast<unsigned>(strtoul(arg, nullptr, 10));
+      break;
     case ARGP_KEY_ARG:
       argp_usage(state);
       break;
@@ -205,6 +245,20 @@ void set_params(const std::string& ant, unsigned fc, double g, unsigned sr, unsi
   restart = true;
 }
 
+/**
+ * Map the MBSFN subcarrier spacing signalled in SIB13 to the corresponding srsran value.
+ */
+static auto to_srsran_scs(Phy::SubcarrierSpacing subcarrier_spacing) -> srsran_scs_t {
+  switch (subcarrier_spacing) {
+    case Phy::SubcarrierSpacing::df_15kHz:  return SRSRAN_SCS_15KHZ;
+    case Phy::SubcarrierSpacing::df_7kHz5:  return SRSRAN_SCS_7KHZ5;
+    case Phy::SubcarrierSpacing::df_2kHz5:  return SRSRAN_SCS_2KHZ5;
+    case Phy::SubcarrierSpacing::df_1kHz25: return SRSRAN_SCS_1KHZ25;
+    case Phy::SubcarrierSpacing::df_0kHz37: return SRSRAN_SCS_0KHZ37;
+  }
+  return SRSRAN_SCS_15KHZ;
+}
+
 /**
  *  Main entry point for the program.
  *  
@@ -214,6 +268,7 @@ void set_params(const std::string& ant, unsigned fc, double g, unsigned sr, unsi
  */
 auto main(int argc, char **argv) -> int {
   try {
+  auto startup_begin = std::chrono::steady_clock::now();
   struct arguments arguments;
   /* Default values */
   arguments.config_file = "/etc/5gmag-rt.conf";
@@ -247,6 +302,19 @@ auto main(int argc, char **argv) -> int {
   // Init and tune the SDR
   auto rx_channels = 1;
   cfg.lookupValue("modem.sdr.rx_channels", rx_channels);
+  if (arguments.allocation_test > 0 && !AllocationTracker::enabled()) {
+    spdlog::error("The allocation test needs a build configured with -DENABLE_ALLOCATION_TRACKING=ON");
+    exit(1);
+  }
+  if (arguments.fft_benchmark) {
+    srsran_use_standard_symbol_size(true);
+    FftWisdom fft_wisdom(cfg);
+    fft_wisdom.load();
+    FftBenchmark benchmark(rx_channels, 200);
+    auto ok = benchmark.run();
+    fft_wisdom.save();
+    exit(ok ? 0 : 1);
+  }
   spdlog::info("Initialising SDR with {} RX channel(s)", rx_channels);
   SdrReader sdr(cfg, rx_channels);
   if (arguments.list_sdr_devices) {
@@ -300,6 +368,17 @@ auto main(int argc, char **argv) -> int {
   cfg.lookupValue("modem.phy.thread_priority_rt", phy_prio);
   thread_pool pool{ thread_cnt + 1, phy_prio };
 
+  // Let large FFTs use idle pool threads. FFTW threading must be set up before loading wisdom.
+  ParallelFft parallel_fft(cfg, pool);
+  if (!parallel_fft.init()) {
+    spdlog::error("Failed to set up parallel FFTs. Exiting.");
+    exit(1);
+  }
+
+  // Load FFTW wisdom before the first FFT gets planned
+  FftWisdom fft_wisdom(cfg);
+  fft_wisdom.load();
+
   // Elevate execution to real time scheduling
   struct sched_param thread_param = {};
   thread_param.sched_priority = 20;
@@ -337,54 +416,114 @@ auto main(int argc, char **argv) -> int {
  auto& asn1_log = srslog::fetch_basic_logger("ASN1");
   asn1_log.set_level(srs_level);
 
+  // Huge page backed memory for the PHY sample buffers
+  HugePageArena arena(cfg);
+  if (!arena.init()) {
+    spdlog::error("Failed to create PHY memory arena. Exiting.");
+    exit(1);
+  }
+
   // Create the layer components: Phy, RLC, RRC and GW
   Phy phy(
       cfg,
       std::bind(&SdrReader::get_samples, &sdr, _1, _2, _3),  // NOLINT
       arguments.file_bw ? arguments.file_bw * 5 : 25,
       arguments.override_nof_prb,
-      rx_channels);
+      rx_channels,
+      arena);
 
   phy.init();
 
+  state_t state = searching;
+
+  // Create the RESTful API handler
+  std::string uri = "http://0.0.0.0:3010/modem-api/";
+  cfg.lookupValue("modem.restful_api.uri", uri);
+  spdlog::info("Starting RESTful API handler at {}", uri);
+  RestHandler rest_handler(cfg, uri, state, sdr, phy, set_params);
+
   srsran::pdcp pdcp(nullptr, "PDCP");
   srsran::rlc rlc("RLC");
   srsran::timer_handler timers;
 
   Rrc rrc(cfg, phy, rlc);
-  Gw gw(cfg, phy);
-  gw.init();
+  Gw gw(cfg, phy, rest_handler);
+  if (!gw.init()) {
+    spdlog::error("Failed to set up the network output. Exiting.");
+    exit(1);
+  }
+  if (arguments.gw_benchmark > 0) {
+    GwBenchmark benchmark(gw, rest_handler, arguments.gw_benchmark, 10);
+    exit(benchmark.run() ? 0 : 1);
+  }
 
   rlc.init(&pdcp, &rrc, &timers, 0 /* RB_ID_SRB0 */);
   pdcp.init(&rlc, &rrc,  &gw);
 
-
-
-  state_t state = searching;
-
-  // Create the RESTful API handler
-  std::string uri = "http://0.0.0.0:3010/modem-api/";
-  cfg.lookupValue("modem.restful_api.uri", uri);
-  spdlog::info("Starting RESTful API handler at {}", uri);
-  RestHandler rest_handler(cfg, uri, state, sdr, phy, set_params);
-
   // Initialize one CAS and thered_cnt MBSFN frame processors
-  CasFrameProcessor cas_processor(cfg, phy, rlc, rest_handler, rx_channels);
-  if (!cas_processor.init()) {
-    spdlog::error("Failed to create CAS processor. Exiting.");
+  // Decides whether MBSFN subframes are decoded from all antennas or just the best one
+  AntennaSelector antenna_selector(cfg, rx_channels);
+
+  // The frame processors are constructed and initialized on the pool threads, in parallel to each other
+  // and to the cell search. They are waited for before the first subframe is handed to them.
+  std::vector<std::future<bool>> processor_init;
+
+  std::unique_ptr<CasFrameProcessor> cas_processor;
+  ProcessorPool<CasFrameProcessor> cas_pool;
+  processor_init.push_back(pool.push([&] {
+    cas_processor = std::make_unique<CasFrameProcessor>(cfg, phy, rlc, rest_handler, arena, antenna_selector, rx_channels);
+    if (!cas_processor->init()) {
+      spdlog::error("Failed to create CAS processor.");
+      return false;
+    }
+    cas_pool.add(cas_processor.get());
+    return true;
+  }));
+
+  // Contexts for decoding the code blocks of large PMCH TBs on idle pool threads
+  CodeblockDecoder cb_decoder(cfg, pool);
+  if (!cb_decoder.init()) {
+    spdlog::error("Failed to create code block decoder. Exiting.");
     exit(1);
   }
 
-  std::vector<MbsfnFrameProcessor*> mbsfn_processors;
+  // Channel estimate shared between the MBSFN processors, for filtering it over time
+  ChannelStateStore ce_store(cfg);
+
+  // Passes the PDUs of the MBSFN subframes to RLC in TTI order, no matter in which order their processing completes
+  MchReorderBuffer mch_reorder(cfg, rlc, rest_handler, pool);
+
+  // Idle MBSFN processors. The main loop takes one from here for every batch of subframes, and the worker
+  // thread puts it back after processing.
+  ProcessorPool<MbsfnFrameProcessor> mbsfn_pool;
+  std::vector<MbsfnFrameProcessor*> mbsfn_processors(thread_cnt, nullptr);
   for (auto i = 0U; i < thread_cnt; i++) {
-    auto p = new MbsfnFrameProcessor(cfg, rlc, phy, mac_log, rest_handler, rx_channels);
-    if (!p->init()) {
-      spdlog::error("Failed to create MBSFN processor. Exiting.");
-      exit(1);
-    }
-    mbsfn_processors.push_back(p);
+    processor_init.push_back(pool.push([&, i] {
+      mbsfn_processors[i] = new MbsfnFrameProcessor(cfg, phy, mac_log, rest_handler, cb_decoder, ce_store, mch_reorder, antenna_selector, arena, rx_channels);
+      if (!mbsfn_processors[i]->init()) {
+        spdlog::error("Failed to create MBSFN processor.");
+        return false;
+      }
+      mbsfn_pool.add(mbsfn_processors[i]);
+      return true;
+    }));
   }
 
+  // Blocks until all frame processors are initialized. Returns false if any of them failed.
+  auto wait_for_processors = [&processor_init, &startup_begin]() {
+    if (processor_init.empty()) {
+      return true;
+    }
+    bool ok = true;
+    for (auto& init : processor_init) {
+      ok = init.get() && ok;
+    }
+    processor_init.clear();
+    spdlog::info("Frame processors ready {} ms after startup",
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startup_begin).count());
+    return ok;
+  };
+
   // Start receiving sample data
   sdr.start();
 
@@ -395,12 +534,30 @@ auto main(int argc, char **argv) -> int {
   measurement_interval *= 1000;
   uint32_t tick = 0;
 
+  // Steady-state allocation test: processing time checked so far, and what was found in it
+  uint32_t allocation_test_ms = 0;
+  uint64_t allocation_test_allocations = 0;
+  uint64_t allocation_test_mbsfn_subframes = 0;
+
   // Initial state: searching a cell
   state = searching;
+  spdlog::info("Startup took {} ms",
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startup_begin).count());
+
+  // Time (re)synchronization started, for reporting the time to sync
+  auto sync_begin = startup_begin;
+  bool sync_pending = true;
+
+  // Cell, area and subcarrier spacing the MBSFN processors are configured for. Shared by all of them.
+  std::shared_ptr<const CellContext> cell_context;
 
   // Start the main processing loop
   for (;;) {
     if (state == searching) {
+      if (!sync_pending) {
+        sync_begin = std::chrono::steady_clock::now();
+        sync_pending = true;
+      }
       if (restart) {
         sdr.stop();
         sample_rate = search_sample_rate;  // sample rate for searching
@@ -442,6 +599,9 @@ auto main(int argc, char **argv) -> int {
             sdr.start();
           }
         }
+        // Plan the FFTs of all MBSFN numerologies for this bandwidth while syncing
+        fft_wisdom.plan(mbsfn_nof_prb);
+
         spdlog::debug("Synchronizing subframe");
         // ... and move to syncing state.
         state = syncing;
@@ -467,13 +627,13 @@ auto main(int argc, char **argv) -> int {
 
       if (sfn_sync) {
         // We're locked on to the cell, and have succesfully received the MIB at the target sample rate.
-        spdlog::info("Decoded MIB at target sample rate, TTI is {}. Subframe synchronized.", phy.tti());
-
-        // Set the cell parameters in the CAS processor
-        cas_processor.set_cell(phy.cell());
+        spdlog::info("Decoded MIB at target sample rate, TTI is {}. Subframe synchronized after {} ms.", phy.tti(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - sync_begin).count());
+        sync_pending = false;
 
-        for (auto i = 0U; i < thread_cnt; i++) {
-          mbsfn_processors[i]->unlock();
+        if (!wait_for_processors()) {
+          spdlog::error("Failed to create frame processors. Exiting.");
+          exit(1);
         }
 
         // Get the initial TTI / subframe ID (= system frame number * 10 + subframe number)
@@ -481,6 +641,42 @@ auto main(int argc, char **argv) -> int {
         // Reset the RRC
         rrc.reset();
 
+        // Size all frame processors for the cell, once they have finished processing any pending subframe.
+        // This allocates their buffers and sets up the FFTs, so it runs on the pool for all of them in parallel
+        // instead of on the main loop when each processor is first used.
+        auto cell_setup_begin = std::chrono::steady_clock::now();
+        uint8_t area_id = phy.mcch_configured() ? phy.mbsfn_area_id() : 0;
+        srsran_scs_t scs = phy.mcch_configured() ? to_srsran_scs(phy.mbsfn_subcarrier_spacing()) : SRSRAN_SCS_15KHZ;
+        if (!cell_context || !cell_context->matches(phy.cell(), area_id, scs)) {
+          cell_context = CellContext::create(phy.cell(), area_id, scs);
+        }
+        std::vector<std::future<bool>> cell_setup;
+        auto cas = cas_pool.acquire();
+        cell_setup.push_back(pool.push([cas, &phy] { return cas->set_cell(phy.cell()); }));
+        std::vector<MbsfnFrameProcessor*> mbsfn_idle;
+        for (auto i = 0U; i < mbsfn_pool.size(); i++) {
+          mbsfn_idle.push_back(mbsfn_pool.acquire());
+          cell_setup.push_back(pool.push([p = mbsfn_idle.back(), &cell_context] { return p->configure(cell_context); }));
+        }
+        cell_setup.push_back(pool.push([&cb_decoder, &cell_context] { return cb_decoder.set_cell(cell_context->mbsfn_cell().nof_prb); }));
+        bool cell_setup_ok = true;
+        for (auto& setup : cell_setup) {
+          cell_setup_ok = setup.get() && cell_setup_ok;
+        }
+        if (!cell_setup_ok) {
+          spdlog::error("Failed to allocate frame processor buffers. Exiting.");
+          exit(1);
+        }
+        // All processors are held here, so none of them plans FFTs. The main loop never returns, and exit()
+        // skips the FftWisdom destructor, so this is where new wisdom reaches the disk.
+        fft_wisdom.save(false);
+        cas_pool.release(cas);
+        for (auto p : mbsfn_idle) {
+          mbsfn_pool.release(p);
+        }
+        spdlog::info("Frame processors set up for {} PRB in {} ms", phy.nr_prb(),
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - cell_setup_begin).count());
+
         // Ready to receive actual data. Go to processing state.
         state = processing;
 
@@ -488,19 +684,51 @@ auto main(int argc, char **argv) -> int {
         sdr.enableSampleFileWriting();
       }
     } else {  // processing
-      int mb_idx = 0;
+      // The MBSFN processor currently collecting a batch of subframes, if any
+      MbsfnFrameProcessor* mbsfn_batch = nullptr;
+      auto flush_mbsfn_batch = [&mbsfn_batch, &mbsfn_pool, &pool]() {
+        if (mbsfn_batch == nullptr) {
+          return;
+        }
+        if (mbsfn_batch->batch_empty()) {
+          mbsfn_pool.release(mbsfn_batch);
+        } else {
+          // Hand the processor and its buffers over to a pool thread, which releases it when done
+          pool.post([ObjectPtr = mbsfn_batch, &mbsfn_pool] {
+            ObjectPtr->process();
+            mbsfn_pool.release(ObjectPtr);
+          });
+        }
+        mbsfn_batch = nullptr;
+      };
+      // Size an MBSFN processor for the current cell context on a pool thread, which releases it when done.
+      // Allocating its buffers and planning its FFTs would stall the main loop.
+      auto reconfigure_mbsfn = [&mbsfn_pool, &pool, &cell_context](MbsfnFrameProcessor* processor) {
+        pool.post([ObjectPtr = processor, context = cell_context, &mbsfn_pool] {
+          if (!ObjectPtr->configure(context)) {
+            spdlog::error("Failed to allocate MBSFN processor buffers. Exiting.");
+            exit(1);
+          }
+          mbsfn_pool.release(ObjectPtr);
+        });
+      };
+
       while (state == processing) {
+        auto allocations_at_tti_start = AllocationTracker::thread_allocations();
         tti = (tti + 1) % 10240; // Clamp the TTI
         if (phy.is_cas_subframe(tti)) {
+          flush_mbsfn_batch();
           // Get the samples from the SDR interface, hand them to a CAS processor, and start it
           // on a thread from the pool.
-          if (!restart && phy.get_next_frame(cas_processor.rx_buffer(), cas_processor.rx_buffer_size())) {
+          auto cas = cas_pool.acquire();
+          if (!restart && phy.get_next_frame(cas->rx_buffer(), cas->rx_buffer_size())) {
             spdlog::debug("sending tti {} to regular processor", tti);
-            pool.push([ObjectPtr = &cas_processor, tti, &rest_handler] {
+            pool.post([ObjectPtr = cas, tti, &rest_handler, &cas_pool] {
                 if (ObjectPtr->process(tti)) {
                 // Set constellation diagram data and rx params for CAS in the REST API handler
                 rest_handler.add_cinr_value(ObjectPtr->cinr_db());
                 }
+                cas_pool.release(ObjectPtr);
                 });
 
 
@@ -510,6 +738,7 @@ auto main(int argc, char **argv) -> int {
               // portion of the frames can be wider. We need to...
 
               mbsfn_nof_prb = phy.nof_mbsfn_prb();
+              fft_wisdom.plan(mbsfn_nof_prb);
 
               // ...adjust the SDR's sample rate to fit the wider MBSFN bandwidth...
               unsigned new_srate = srsran_sampling_freq_hz(mbsfn_nof_prb);
@@ -517,7 +746,12 @@ auto main(int argc, char **argv) -> int {
               // ... configure the PHY and CAS processor to decode a narrow CAS and wider MBSFN, and move back to syncing state
               // after reconfiguring and restarting the SDR.
               phy.set_cell();
-              cas_processor.set_cell(phy.cell());
+              cas = cas_pool.acquire();
+              if (!cas->set_cell(phy.cell())) {
+                spdlog::error("Failed to allocate CAS processor buffers. Exiting.");
+                exit(1);
+              }
+              cas_pool.release(cas);
               if (new_srate != sample_rate) {
                 spdlog::info("Setting sample rate {} Mhz for MBSFN with {} PRB / {} Mhz channel width", new_srate/1000000.0, mbsfn_nof_prb,
                     mbsfn_nof_prb * 0.2);
@@ -530,6 +764,11 @@ auto main(int argc, char **argv) -> int {
             }
           } else {
             // Failed to receive data, or sync lost. Go back to searching state.
+            if (arguments.allocation_test > 0) {
+              spdlog::error("Allocation test failed: synchronization lost after {} ms", allocation_test_ms);
+              exit(1);
+            }
+            cas_pool.release(cas);
             sdr.stop();
             sample_rate = search_sample_rate;  // sample rate for searching
             sdr.tune(frequency, sample_rate, bandwidth, gain, antenna, use_agc);
@@ -542,38 +781,71 @@ auto main(int argc, char **argv) -> int {
           }
         } else {
           // All other frames in FeMBMS dedicated mode are MBSFN frames.
-          spdlog::debug("sending tti {} to mbsfn proc {}", tti, mb_idx);
+          // Buffers are sized for the MBSFN bandwidth and subcarrier spacing of the current cell. Until
+          // SIB1/SIB13 have been received in CAS, the processors are sized for 15 kHz spacing.
+          uint8_t area_id = phy.mcch_configured() ? phy.mbsfn_area_id() : 0;
+          srsran_scs_t scs = phy.mcch_configured() ? to_srsran_scs(phy.mbsfn_subcarrier_spacing()) : SRSRAN_SCS_15KHZ;
+          if (!cell_context || !cell_context->matches(phy.cell(), area_id, scs)) {
+            cell_context = CellContext::create(phy.cell(), area_id, scs);
+            // Process what's been collected for the old configuration, and reconfigure all idle processors
+            // in parallel. Busy ones are reconfigured when they are acquired next.
+            flush_mbsfn_batch();
+            for (auto i = mbsfn_pool.size(); i > 0; i--) {
+              auto idle = mbsfn_pool.try_acquire();
+              if (idle == nullptr) {
+                break;
+              }
+              reconfigure_mbsfn(idle);
+            }
+          }
+          if (mbsfn_batch == nullptr) {
+            // Start a new batch on an idle processor. This only waits if all of them are busy.
+            mbsfn_batch = mbsfn_pool.acquire();
+            mbsfn_batch->start_batch();
+          }
+          while (mbsfn_batch->cell_context() != cell_context) {
+            // Sized for an earlier configuration. Wait for one that has been reconfigured instead.
+            reconfigure_mbsfn(mbsfn_batch);
+            mbsfn_batch = mbsfn_pool.acquire();
+            mbsfn_batch->start_batch();
+          }
+          spdlog::debug("sending tti {} to mbsfn proc {}", tti, static_cast<void*>(mbsfn_batch));
 
-          // Get the samples from the SDR interface, hand them to an MNSFN processor, and start it
-          // on a thread from the pool. Getting the buffer pointer from the pool also locks this processor.
-          if (!restart && phy.get_next_frame(mbsfn_processors[mb_idx]->get_rx_buffer_and_lock(), mbsfn_processors[mb_idx]->rx_buffer_size())) {
+          // Get the samples from the SDR interface and add them to the MBSFN processor's batch.
+          if (!restart && phy.get_next_frame(mbsfn_batch->rx_buffer(), mbsfn_batch->rx_buffer_size())) {
             if (phy.mcch_configured() && phy.is_mbsfn_subframe(tti)) {
-              // If data frm SIB1/SIB13 has been received in CAS, configure the processors accordingly
-              if (!mbsfn_processors[mb_idx]->mbsfn_configured()) {
-                srsran_scs_t scs = SRSRAN_SCS_15KHZ;
-                switch (phy.mbsfn_subcarrier_spacing()) {
-                  case Phy::SubcarrierSpacing::df_15kHz:  scs = SRSRAN_SCS_15KHZ; break;
-                  case Phy::SubcarrierSpacing::df_7kHz5:  scs = SRSRAN_SCS_7KHZ5; break;
-                  case Phy::SubcarrierSpacing::df_2kHz5:  scs = SRSRAN_SCS_2KHZ5; break;
-                  case Phy::SubcarrierSpacing::df_1kHz25: scs = SRSRAN_SCS_1KHZ25; break;
-                  case Phy::SubcarrierSpacing::df_0kHz37: scs = SRSRAN_SCS_0KHZ37; break;
-                }
-                auto cell = phy.cell();
-                cell.nof_prb = cell.mbsfn_prb;
-                mbsfn_processors[mb_idx]->set_cell(cell);
-                mbsfn_processors[mb_idx]->configure_mbsfn(phy.mbsfn_area_id(), scs);
+              // Data from SIB1/SIB13 has been received in CAS, and the processor has been configured accordingly above
+              unsigned mch_idx = 0;
+              auto mbsfn_cfg = phy.mbsfn_config_for_tti(tti, mch_idx);
+              mbsfn_batch->add_to_batch(tti, std::chrono::steady_clock::now() - std::chrono::microseconds(sdr.get_buffered_us()),
+                  phy.frame_samples(), mch_reorder.expect(mbsfn_cfg.is_mcch, mch_idx));
+
+              // Start processing on a thread from the pool once the batch is full, or if the next subframe
+              // has a different configuration (or is no MBSFN subframe at all).
+              if (mbsfn_batch->batch_full() || !phy.mbsfn_config_matches(tti, (tti + 1) % 10240)) {
+                flush_mbsfn_batch();
               }
-              pool.push([ObjectPtr = mbsfn_processors[mb_idx], tti] {
-                ObjectPtr->process(tti);
-              });
             } else {
               // Nothing to do yet, we lack the data from SIB1/SIB13
-              // Discard the samples and unlock the processor.
-              mbsfn_processors[mb_idx]->unlock();
+              // Discard the samples and release the processor.
+              flush_mbsfn_batch();
             }
           } else {
             // Failed to receive data, or sync lost. Go back to searching state.
             spdlog::warn("Synchronization lost while processing. Going back to searching state.");
+            if (arguments.allocation_test > 0) {
+              spdlog::error("Allocation test failed: synchronization lost after {} ms", allocation_test_ms);
+              exit(1);
+            }
+            if (mbsfn_batch != nullptr) {
+              // Complete the tickets of the subframes collected so far. This may deliver, so it's done on the pool.
+              pool.post([ObjectPtr = mbsfn_batch, &mbsfn_pool] {
+                ObjectPtr->discard_batch();
+                mbsfn_pool.release(ObjectPtr);
+              });
+              mbsfn_batch = nullptr;
+            }
+
             sdr.stop();
             sample_rate = search_sample_rate;  // sample rate for searching
             sdr.tune(frequency, sample_rate, bandwidth, gain, antenna, use_agc);
@@ -584,7 +856,11 @@ auto main(int argc, char **argv) -> int {
             rrc.reset();
             phy.reset();
           }
-          mb_idx = static_cast<int>((mb_idx + 1) % thread_cnt);
+        }
+
+        if (AllocationTracker::enabled()) {
+          AllocationTracker::add(AllocationTracker::Stage::main_loop,
+              AllocationTracker::thread_allocations() - allocations_at_tti_start);
         }
 
         tick++;
@@ -637,6 +913,70 @@ auto main(int argc, char **argv) -> int {
                   });
                 mch_idx++;
               });
+          auto latency = rest_handler._mbsfn_latency.summary(true);
+          std::for_each(std::begin(latency), std::end(latency), [](LatencyStats::summary_t const& l) {
+              spdlog::info("MBSFN subframe latency at MCS {}: {} subframes, p50 {} us, p99 {} us, max {} us",
+                  l.key, l.count, l.p50_us, l.p99_us, l.max_us);
+              });
+          if (sdr.get_sdr_sample_rate() != sdr.get_sample_rate()) {
+            auto us_per_msps = sdr.resampler_us_per_msps(true);
+            spdlog::info("Resampler {} -> {} Msps: {:.0f} us CPU per million samples ({:.1f} % of a core)",
+                sdr.get_sdr_sample_rate() / 1000000.0, sdr.get_sample_rate() / 1000000.0,
+                us_per_msps, us_per_msps * sdr.get_sdr_sample_rate() / 1e10);
+          }
+          auto rx_latency = rest_handler._mbsfn_rx_latency.summary(true);
+          std::for_each(std::begin(rx_latency), std::end(rx_latency), [](LatencyStats::summary_t const& l) {
+              spdlog::info("MBSFN reception to decoded TB at MCS {}: {} subframes, p50 {} us, p99 {} us, max {} us",
+                  l.key, l.count, l.p50_us, l.p99_us, l.max_us);
+              });
+          auto delivery_latency = rest_handler._mch_delivery_latency.summary(true);
+          std::for_each(std::begin(delivery_latency), std::end(delivery_latency), [](LatencyStats::summary_t const& l) {
+              spdlog::info("MCH delivery to RLC on reorder lane {}: {} subframes, p50 {} us, p99 {} us, max {} us",
+                  l.key, l.count, l.p50_us, l.p99_us, l.max_us);
+              });
+          auto fft_latency = rest_handler._mbsfn_fft_latency.summary(true);
+          std::for_each(std::begin(fft_latency), std::end(fft_latency), [](LatencyStats::summary_t const& l) {
+              spdlog::info("MBSFN FFT/CE time with {} helper(s): {} subframes, p50 {} us, p99 {} us, max {} us",
+                  l.key, l.count, l.p50_us, l.p99_us, l.max_us);
+              });
+          if (AllocationTracker::enabled()) {
+            const std::pair<AllocationTracker::Stage, const char*> stages[] = {  // NOLINT
+              {AllocationTracker::Stage::main_loop, "main loop"},
+              {AllocationTracker::Stage::cas_subframe, "CAS processing"},
+              {AllocationTracker::Stage::mbsfn_subframe, "MBSFN processing"}};
+            uint64_t interval_allocations = 0;
+            uint64_t interval_mbsfn_subframes = 0;
+            for (const auto& stage : stages) {
+              auto allocations = AllocationTracker::summary(stage.first, true);
+              if (allocations.allocations > 0) {
+                spdlog::warn("Heap allocations in {}: {} in {} TTIs, max {} per TTI",
+                    stage.second, allocations.allocations, allocations.ttis, allocations.max_per_tti);
+              } else {
+                spdlog::info("Heap allocations in {}: none in {} TTIs", stage.second, allocations.ttis);
+              }
+              interval_allocations += allocations.allocations;
+              if (stage.first == AllocationTracker::Stage::mbsfn_subframe) {
+                interval_mbsfn_subframes = allocations.ttis;
+              }
+            }
+
+            // The first interval is warm-up: SIB and MCCH acquisition, and buffers growing to the TBs of the cell
+            if (arguments.allocation_test > 0 && tick > measurement_interval) {
+              allocation_test_ms += measurement_interval;
+              allocation_test_allocations += interval_allocations;
+              allocation_test_mbsfn_subframes += interval_mbsfn_subframes;
+              if (allocation_test_ms >= arguments.allocation_test * 1000) {
+                if (allocation_test_allocations > 0 || allocation_test_mbsfn_subframes == 0) {
+                  spdlog::error("Allocation test failed: {} heap allocations in {} MBSFN subframes and {} ms of steady-state processing",
+                      allocation_test_allocations, allocation_test_mbsfn_subframes, allocation_test_ms);
+                  exit(1);
+                }
+                spdlog::info("Allocation test passed: no heap allocations in {} MBSFN subframes and {} ms of steady-state processing",
+                    allocation_test_mbsfn_subframes, allocation_test_ms);
+                exit(0);
+              }
+            }
+          }
           spdlog::info("-----");
           if (enable_measurement_file) {
             measurement_file.WriteLogValues(cols);
@@ -647,6 +987,7 @@ auto main(int argc, char **argv) -> int {
   }
 
   // Main loop ended by signal. Free the MBSFN processors, and bail.
+  wait_for_processors();
   for (auto i = 0U; i < thread_cnt; i++) {
     delete( mbsfn_processors[i] );
   }
@@ -0,0 +1,99 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <array>
+#include <string>
+
+#include <libconfig.h++>
+#include "spdlog/spdlog.h"
+#include "AntennaSelector.h"
+
+/**
+ *  Walks the antenna selector through its hysteresis transitions with two antennas, and fails if
+ *  it selects anything else than expected.
+ */
+static const char* kConfig =
+  "modem: { phy: { antenna_selection: {"
+  "  enabled = true; enter_snr_db = 20.0; exit_snr_db = 15.0; holdoff_subframes = 2;"
+  "}; }; };";
+
+// Enough CAS subframes for the smoothed SNR to reach the reported one
+static const unsigned kSettleSubframes = 300;
+
+static unsigned failures = 0;
+
+static void settle(AntennaSelector& selector, std::array<float, 2> snr_db) {
+  for (auto i = 0U; i < kSettleSubframes; i++) {
+    selector.report_snr(snr_db.data());
+  }
+}
+
+static void expect(const AntennaSelector& selector, int antenna, const std::string& step) {
+  if (selector.selected() != antenna) {
+    spdlog::error("{}: selected {}, expected {}", step, selector.selected(), antenna);
+    failures++;
+  }
+}
+
+auto main() -> int {
+  libconfig::Config cfg;
+  cfg.readString(kConfig);
+  AntennaSelector selector(cfg, 2);
+
+  settle(selector, {25, 18});
+  expect(selector, AntennaSelector::kAllAntennas, "High SNR before any MBSFN subframe was decoded");
+
+  selector.report_crc(0, true);
+  selector.report_crc(1, true);
+  settle(selector, {25, 18});
+  expect(selector, 0, "Best antenna above enter_snr_db after the holdoff");
+
+  settle(selector, {17, 19});
+  expect(selector, 0, "Selected antenna between exit_snr_db and enter_snr_db, other one better");
+
+  settle(selector, {10, 18});
+  expect(selector, AntennaSelector::kAllAntennas, "Selected antenna below exit_snr_db, other one above it");
+
+  settle(selector, {25, 18});
+  expect(selector, 0, "Best antenna above enter_snr_db again");
+
+  settle(selector, {10, 25});
+  expect(selector, 1, "Selected antenna below exit_snr_db, other one above enter_snr_db");
+
+  selector.report_crc(2, false);
+  expect(selector, AntennaSelector::kAllAntennas, "CRC error");
+
+  settle(selector, {25, 25});
+  expect(selector, AntennaSelector::kAllAntennas, "High SNR during the holdoff after a CRC error");
+
+  selector.report_crc(3, true);
+  selector.report_crc(4, true);
+  settle(selector, {25, 21});
+  expect(selector, 0, "Best antenna above enter_snr_db after the holdoff");
+
+  settle(selector, {14, 14});
+  expect(selector, AntennaSelector::kAllAntennas, "All antennas below exit_snr_db");
+
+  if (failures > 0) {
+    spdlog::error("{} antenna selection transitions failed", failures);
+    return 1;
+  }
+  spdlog::info("All antenna selection transitions passed");
+  return 0;
+}
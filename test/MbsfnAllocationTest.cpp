@@ -0,0 +1,197 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <libconfig.h++>
+#include "spdlog/spdlog.h"
+#include "srsran/srsran.h"
+#include "srsran/interfaces/rrc_interface_types.h"
+#include "srsran/rlc/rlc.h"
+#include "thread_pool.hpp"
+#include "AllocationTracker.h"
+#include "AntennaSelector.h"
+#include "CellContext.h"
+#include "ChannelStateStore.h"
+#include "CodeblockDecoder.h"
+#include "HugePageArena.h"
+#include "MbsfnFrameProcessor.h"
+#include "MchReorderBuffer.h"
+#include "ParallelFft.h"
+#include "Phy.h"
+#include "ProcessorPool.h"
+#include "RestHandler.h"
+#include "SdrReader.h"
+
+/**
+ *  Hands synthetic MBSFN subframes to a pool of MBSFN processors the way the main loop does, and
+ *  fails if the main loop or MBSFN processing allocate once the processors have warmed up.
+ *
+ *  The subframes are white noise, so every PMCH fails its CRC. FFT, channel estimation, demodulation,
+ *  parallel code block decoding and the reorder buffer run as they do for a received signal. MAC PDU
+ *  parsing and RLC delivery are only covered by steady_state_allocations, which replays a recorded
+ *  sample file.
+ */
+static const char* kConfig =
+  "modem: { phy: { mbsfn_batch_size = 1; huge_pages: { enabled = false; }; }; };";
+
+static const char* kRestUri = "http://127.0.0.1:3011/modem-api-test/";
+
+static const unsigned kThreads = 4;
+static const uint32_t kNofPrb = 25;
+static const uint8_t kAreaId = 1;
+static const uint8_t kDataMcs = 20;  // TBs of several code blocks at 25 PRB
+
+static const unsigned kWarmupSubframes = 200;
+static const unsigned kSubframes = 2000;
+
+auto main() -> int {
+  // Every PMCH fails its CRC, which is logged as a warning
+  spdlog::set_level(spdlog::level::err);
+  srsran_use_standard_symbol_size(true);
+  srslog::init();
+
+  libconfig::Config cfg;
+  cfg.readString(kConfig);
+
+  thread_pool pool{ kThreads + 1, 1 };
+  ParallelFft parallel_fft(cfg, pool);
+  HugePageArena arena(cfg);
+  if (!parallel_fft.init() || !arena.init()) {
+    spdlog::error("Could not set up parallel FFTs and the PHY memory arena");
+    return 1;
+  }
+
+  // The PHY only provides the MBSFN configuration. It is not initialized, and never asked for samples.
+  Phy phy(cfg, [](cf_t** /*data*/, uint32_t /*nsamples*/, srsran_timestamp_t* /*rx_time*/) { return 0; },
+      kNofPrb, -1, 1, arena);
+
+  // One MBSFN area without MCCH subframes, and one MCH in all MBSFN subframes
+  srsran::sib13_t sib13 = {};
+  sib13.nof_mbsfn_area_info = 1;
+  sib13.mbsfn_area_info_list[0].mbsfn_area_id = kAreaId;
+  phy.set_mch_scheduling_info(sib13);
+  phy.set_nof_mbsfn_prb(kNofPrb);
+
+  srsran::mcch_msg_t mcch = {};
+  mcch.nof_pmch_info = 1;
+  mcch.pmch_info_list[0].data_mcs = kDataMcs;
+  mcch.pmch_info_list[0].sf_alloc_end = UINT16_MAX;
+  phy.set_mbsfn_config(mcch);
+
+  srsran_cell_t cell = {};
+  cell.id = 1;
+  cell.nof_prb = kNofPrb;
+  cell.mbsfn_prb = kNofPrb;
+  cell.nof_ports = 1;
+  cell.cp = SRSRAN_CP_NORM;
+  auto cell_context = CellContext::create(cell, kAreaId, SRSRAN_SCS_15KHZ);
+
+  state_t state = processing;
+  SdrReader sdr(cfg, 1);
+  RestHandler rest_handler(cfg, kRestUri, state, sdr, phy,
+      [](const std::string& /*antenna*/, unsigned /*fcen*/, double /*gain*/, unsigned /*sample_rate*/, unsigned /*bandwidth*/) {});
+  srsran::rlc rlc("RLC");
+
+  AntennaSelector antenna_selector(cfg, 1);
+  ChannelStateStore ce_store(cfg);
+  MchReorderBuffer mch_reorder(cfg, rlc, rest_handler, pool);
+  CodeblockDecoder cb_decoder(cfg, pool);
+  if (!cb_decoder.init() || !cb_decoder.set_cell(kNofPrb)) {
+    spdlog::error("Could not set up the code block decoder");
+    return 1;
+  }
+
+  auto& mac_log = srslog::fetch_basic_logger("MAC");
+  std::vector<std::unique_ptr<MbsfnFrameProcessor>> processors;
+  ProcessorPool<MbsfnFrameProcessor> mbsfn_pool;
+  for (auto i = 0U; i < kThreads; i++) {
+    processors.push_back(std::make_unique<MbsfnFrameProcessor>(cfg, phy, mac_log, rest_handler, cb_decoder, ce_store,
+          mch_reorder, antenna_selector, arena, 1));
+    if (!processors.back()->init() || !processors.back()->configure(cell_context)) {
+      spdlog::error("Could not set up MBSFN processor");
+      return 1;
+    }
+    mbsfn_pool.add(processors.back().get());
+  }
+
+  auto sf_len = cell_context->sf_len();
+  std::vector<cf_t> noise(sf_len);
+  std::mt19937 rng(1);
+  std::normal_distribution<float> sample(0.0F, 0.1F);
+  auto iq = reinterpret_cast<float*>(noise.data());
+  for (auto i = 0U; i < 2 * sf_len; i++) {
+    iq[i] = sample(rng);
+  }
+
+  // Same steps as the main loop for every MBSFN subframe, with batches of one subframe
+  uint32_t tti = 0;
+  auto run = [&](unsigned subframes) {
+    for (auto n = 0U; n < subframes; tti = (tti + 1) % 10240) {
+      unsigned mch_idx = 0;
+      if (!phy.is_mbsfn_subframe(tti) || !phy.mbsfn_config_for_tti(tti, mch_idx).enable) {
+        continue;
+      }
+      auto processor = mbsfn_pool.acquire();
+      processor->start_batch();
+      srsran_vec_cf_copy(processor->rx_buffer()[0], noise.data(), sf_len);
+      processor->add_to_batch(tti, std::chrono::steady_clock::now(), sf_len, mch_reorder.expect(false, mch_idx));
+      pool.post([processor, &mbsfn_pool] {
+        processor->process();
+        mbsfn_pool.release(processor);
+      });
+      n++;
+    }
+  };
+  auto wait_for_processors = [&]() {
+    std::vector<MbsfnFrameProcessor*> idle;
+    for (auto i = 0U; i < kThreads; i++) {
+      idle.push_back(mbsfn_pool.acquire());
+    }
+    for (auto p : idle) {
+      mbsfn_pool.release(p);
+    }
+  };
+
+  run(kWarmupSubframes);
+  wait_for_processors();
+  AllocationTracker::summary(AllocationTracker::Stage::mbsfn_subframe, true);
+
+  auto before = AllocationTracker::thread_allocations();
+  run(kSubframes);
+  auto main_loop = AllocationTracker::thread_allocations() - before;
+  wait_for_processors();
+  auto processing = AllocationTracker::summary(AllocationTracker::Stage::mbsfn_subframe, true);
+
+  // Reorder buffer deliveries may still be queued
+  pool.join();
+  spdlog::set_level(spdlog::level::info);
+
+  if (processing.ttis < kSubframes || processing.allocations > 0 || main_loop > 0) {
+    spdlog::error("MBSFN processing of {} subframes made {} heap allocations (max {} per subframe), handing them out {}",
+        processing.ttis, processing.allocations, processing.max_per_tti, main_loop);
+    return 1;
+  }
+  spdlog::info("Processed {} MBSFN subframes without heap allocations", processing.ttis);
+  return 0;
+}
@@ -0,0 +1,69 @@
+// 5G-MAG Reference Tools
+// MBMS Modem Process
+//
+// Copyright (C) 2021 Klaus Kühnhammer (Österreichische Rundfunksender GmbH & Co KG)
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Affero General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Affero General Public License for more details.
+//
+// You should have received a copy of the GNU Affero General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "spdlog/spdlog.h"
+#include "thread_pool.hpp"
+#include "AllocationTracker.h"
+
+/**
+ *  Hands tasks to the PHY thread pool the way the main loop hands subframes to processors, and
+ *  fails if posting them allocates once the pool has warmed up.
+ */
+static const unsigned kBurst = 256;
+static const unsigned kBursts = 400;
+
+static void post_burst(thread_pool& pool, std::atomic<unsigned>& done) {
+  std::array<uint64_t, 2> capture = {};
+  done = 0;
+  for (auto i = 0U; i < kBurst; i++) {
+    // As large as the processor tasks: a processor pointer, the TTI and two references
+    pool.post([&done, capture, i] {
+      if (capture[0] + i < kBurst) {
+        done++;
+      }
+    });
+  }
+  while (done.load() < kBurst) {
+    std::this_thread::yield();
+  }
+}
+
+auto main() -> int {
+  thread_pool pool(4, 1);
+  std::atomic<unsigned> done = {0};
+
+  post_burst(pool, done);
+
+  auto before = AllocationTracker::thread_allocations();
+  for (auto b = 0U; b < kBursts; b++) {
+    post_burst(pool, done);
+  }
+  auto allocations = AllocationTracker::thread_allocations() - before;
+  if (allocations > 0) {
+    spdlog::error("Posting {} tasks to the thread pool made {} heap allocations", kBurst * kBursts, allocations);
+    return 1;
+  }
+  spdlog::info("Posted {} tasks to the thread pool without heap allocations", kBurst * kBursts);
+  return 0;
+}